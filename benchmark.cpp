@@ -0,0 +1,343 @@
+//
+// Throughput of every sort engine over input sizes and key distributions. Progress goes to
+// stderr, the results are written as one JSON document so runs can be compared over time.
+//
+
+#include "radix_sorter.h"
+#include "cpu_radix.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define znew   (z=36969*(z&65535)+(z>>16))
+#define wnew   (w=18000*(w&65535)+(w>>16))
+#define MWC    ((znew<<16)+wnew )
+static unsigned long z = 362436069, w = 521288629;
+
+#define MIN_LENGTH 1000
+#define MAX_LENGTH 1000000000
+
+// distinct keys of the few unique distribution
+#define FEW_UNIQUE_KEYS 16
+// ranks of the Zipf distribution, rank r is drawn with probability proportional to 1 / r
+#define ZIPF_RANKS (1 << 20)
+// bits of the narrow range distribution, like ids below 2^12
+#define NARROW_BITS 12
+
+enum class Distribution {
+  UNIFORM,
+  SORTED,
+  REVERSE,
+  FEW_UNIQUE,
+  ZIPF,
+  NARROW
+};
+
+static const Distribution distributions[] = {
+    Distribution::UNIFORM, Distribution::SORTED, Distribution::REVERSE,
+    Distribution::FEW_UNIQUE, Distribution::ZIPF, Distribution::NARROW
+};
+
+static const char *distributionName(Distribution distribution) {
+  switch (distribution) {
+    case Distribution::SORTED:
+      return "sorted";
+    case Distribution::REVERSE:
+      return "reverse";
+    case Distribution::FEW_UNIQUE:
+      return "few_unique";
+    case Distribution::ZIPF:
+      return "zipf";
+    case Distribution::NARROW:
+      return "narrow";
+    default:
+      return "uniform";
+  }
+}
+
+template<typename K>
+static K randomBits() {
+  if (sizeof(K) == sizeof(uint64_t)) {
+    uint64_t high = (uint32_t) MWC;
+    return (K) (high << 32 | (uint32_t) MWC);
+  }
+  return (K) (uint32_t) MWC;
+}
+
+template<typename K>
+static void fillKeys(std::vector<K> &keys, Distribution distribution) {
+  const size_t length = keys.size();
+  switch (distribution) {
+    case Distribution::SORTED:
+    case Distribution::REVERSE: {
+      // evenly spread over the whole key range so every digit still varies
+      const K stride = std::max<K>(1, std::numeric_limits<K>::max() / length);
+      for (size_t i = 0; i < length; i++) {
+        keys[i] = (K) (distribution == Distribution::SORTED ? i : length - 1 - i) * stride;
+      }
+      break;
+    }
+    case Distribution::FEW_UNIQUE: {
+      K unique[FEW_UNIQUE_KEYS];
+      for (K &key : unique) {
+        key = randomBits<K>();
+      }
+      for (size_t i = 0; i < length; i++) {
+        keys[i] = unique[MWC % FEW_UNIQUE_KEYS];
+      }
+      break;
+    }
+    case Distribution::ZIPF: {
+      std::vector<double> cdf(ZIPF_RANKS);
+      double sum = 0;
+      for (uint32_t rank = 0; rank < ZIPF_RANKS; rank++) {
+        sum += 1.0 / (rank + 1);
+        cdf[rank] = sum;
+      }
+      for (size_t i = 0; i < length; i++) {
+        const double u = (double) (uint32_t) MWC / 4294967296.0 * sum;
+        const uint64_t rank = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        // odd multiplier: frequent keys land all over the key range instead of next to 0
+        keys[i] = (K) (std::min<uint64_t>(rank, ZIPF_RANKS - 1) * 0x9E3779B97F4A7C15ull);
+      }
+      break;
+    }
+    case Distribution::NARROW:
+      for (size_t i = 0; i < length; i++) {
+        keys[i] = (K) (MWC & ((1u << NARROW_BITS) - 1));
+      }
+      break;
+    default:
+      for (size_t i = 0; i < length; i++) {
+        keys[i] = randomBits<K>();
+      }
+  }
+}
+
+template<typename K>
+static bool isSorted(const std::vector<K> &keys) {
+  return std::is_sorted(keys.begin(), keys.end());
+}
+
+static double millisSince(std::chrono::high_resolution_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+struct BenchmarkOptions {
+  uint32_t deviceIndex = 0;
+  size_t maxLength = MAX_LENGTH;
+  uint32_t repetitions = 3;
+  bool key64 = false;
+  bool narrowKeyRange = false;
+  // adds the GPU time per stage of the best repetition to the Vulkan runs
+  bool stageTimestamps = false;
+  std::vector<std::string> engines = {"cpu", "vulkan", "onesweep", "std"};
+  const char *outputPath = nullptr;
+};
+
+// One sort implementation. sort works in place on the benchmark's copy of the keys,
+// deviceMillis reports the fence wait and stagesJson the timestamp report of the Vulkan engines,
+// both are empty for the others.
+template<typename K>
+struct Engine {
+  std::string name;
+  double setupMillis = 0;
+  size_t maxLength = MAX_LENGTH;
+  std::function<void(std::vector<K> &)> sort;
+  std::function<double()> deviceMillis;
+  std::function<std::string()> stagesJson;
+};
+
+template<typename K>
+static int benchmark(const BenchmarkOptions &options) {
+  ThreadPool pool(std::thread::hardware_concurrency());
+  std::unique_ptr<CpuRadixSorter> cpuSorter;
+  std::unique_ptr<RadixSorter> gpuSorters[2];
+  std::vector<K> scratch;
+
+  // SETUP ENGINES
+  std::vector<Engine<K>> engines;
+  for (const std::string &name : options.engines) {
+    Engine<K> engine;
+    engine.name = name;
+    auto start = std::chrono::high_resolution_clock::now();
+    if (name == "cpu") {
+      cpuSorter = std::make_unique<CpuRadixSorter>(pool, 4, options.narrowKeyRange);
+      engine.sort = [&](std::vector<K> &keys) {
+        scratch.resize(keys.size());
+        cpuSorter->sort(keys.data(), scratch.data(), keys.size());
+      };
+    }
+    else if (name == "vulkan" || name == "onesweep") {
+      const bool onesweep = name == "onesweep";
+      RadixSorterConfig config;
+      config.deviceIndex = options.deviceIndex;
+      config.narrowKeyRange = options.narrowKeyRange;
+      config.engine = onesweep ? RadixEngine::ONESWEEP : RadixEngine::MULTI_PASS;
+      config.validation = false;
+      config.stageTimestamps = options.stageTimestamps;
+      std::unique_ptr<RadixSorter> &sorter = gpuSorters[onesweep];
+      sorter = std::make_unique<RadixSorter>(config);
+      engine.maxLength = onesweep ? (1u << 30) - 1 : UINT32_MAX;
+      engine.sort = [&sorter](std::vector<K> &keys) {
+        sorter->sort(std::span<K>(keys));
+      };
+      engine.deviceMillis = [&sorter]() {
+        return (double) sorter->lastSortMillis();
+      };
+      if (options.stageTimestamps) {
+        engine.stagesJson = [&sorter]() {
+          return sorter->lastStageTimingsJson();
+        };
+      }
+    }
+    else if (name == "std") {
+      engine.sort = [](std::vector<K> &keys) {
+        std::sort(keys.begin(), keys.end());
+      };
+    }
+    else {
+      std::cerr << "Unknown engine " << name << ", expected cpu, vulkan, onesweep or std" << std::endl;
+      exit(-1);
+    }
+    engine.setupMillis = millisSince(start);
+    engines.push_back(std::move(engine));
+  }
+  // SETUP ENGINES - END
+
+  std::ofstream file;
+  if (options.outputPath != nullptr) {
+    file.open(options.outputPath, std::ios::trunc);
+    if (!file.is_open()) {
+      std::cerr << "Failed to open " << options.outputPath << std::endl;
+      exit(-1);
+    }
+  }
+  std::ostream &json = options.outputPath != nullptr ? file : std::cout;
+  json << "{\n  \"keyBits\": " << sizeof(K) * 8 << ",\n  \"threads\": " << pool.size()
+       << ",\n  \"deviceIndex\": " << options.deviceIndex << ",\n  \"repetitions\": " << options.repetitions
+       << ",\n  \"narrowKeyRange\": " << (options.narrowKeyRange ? "true" : "false") << ",\n  \"setupMillis\": {";
+  for (size_t i = 0; i < engines.size(); i++) {
+    json << (i ? ", " : "") << "\"" << engines[i].name << "\": " << engines[i].setupMillis;
+  }
+  json << "},\n  \"runs\": [";
+
+  // RUN BENCHMARKS
+  // The first sort of every size includes growing the engine's buffers, the best of all
+  // repetitions is the steady state. keysPerSecond and gbPerSecond use the best time and
+  // count the key bytes once.
+  bool firstRun = true;
+  bool allSorted = true;
+  std::vector<K> input;
+  std::vector<K> keys;
+  for (size_t length = MIN_LENGTH; length <= options.maxLength; length *= 10) {
+    input.resize(length);
+    for (Distribution distribution : distributions) {
+      fillKeys(input, distribution);
+      for (Engine<K> &engine : engines) {
+        if (length > engine.maxLength) {
+          continue;
+        }
+        std::cerr << engine.name << " " << distributionName(distribution) << " " << length << std::endl;
+        double firstMillis = 0;
+        double bestMillis = 0;
+        double deviceMillis = 0;
+        std::string stagesJson;
+        bool sorted = true;
+        for (uint32_t repetition = 0; repetition < options.repetitions; repetition++) {
+          keys = input;
+          auto start = std::chrono::high_resolution_clock::now();
+          engine.sort(keys);
+          const double millis = millisSince(start);
+          sorted = sorted && isSorted(keys);
+          if (repetition == 0) {
+            firstMillis = millis;
+          }
+          if (repetition == 0 || millis < bestMillis) {
+            bestMillis = millis;
+            deviceMillis = engine.deviceMillis ? engine.deviceMillis() : 0;
+            stagesJson = engine.stagesJson ? engine.stagesJson() : "";
+          }
+        }
+        allSorted = allSorted && sorted;
+
+        const double seconds = std::max(bestMillis, 1e-6) / 1000.0;
+        json << (firstRun ? "\n" : ",\n") << "    {\"engine\": \"" << engine.name
+             << "\", \"distribution\": \"" << distributionName(distribution)
+             << "\", \"length\": " << length
+             << ", \"firstMillis\": " << firstMillis
+             << ", \"bestMillis\": " << bestMillis;
+        if (engine.deviceMillis) {
+          json << ", \"deviceMillis\": " << deviceMillis;
+        }
+        if (!stagesJson.empty()) {
+          json << ", \"stages\": " << stagesJson;
+        }
+        json << ", \"keysPerSecond\": " << length / seconds
+             << ", \"gbPerSecond\": " << length * sizeof(K) / seconds / 1e9
+             << ", \"sorted\": " << (sorted ? "true" : "false") << "}";
+        json.flush();
+        firstRun = false;
+      }
+    }
+  }
+  // RUN BENCHMARKS - END
+
+  json << "\n  ]\n}\n";
+  if (!allSorted) {
+    std::cerr << "Some runs did not sort their keys" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// Usage: RadixBenchmark [device index] [max=<largest length>] [reps=<repetitions>] [u64] [narrow] [stages]
+//                       [engines=<cpu,vulkan,onesweep,std>] [out=<json file>]
+// Lengths go from 1K up to max, 10^9 by default, in steps of 10x.
+int main(int argc, const char *const argv[]) {
+  BenchmarkOptions options;
+  if (argc > 1) {
+    options.deviceIndex = std::strtol(argv[1], nullptr, 10);
+  }
+  for (int i = 2; i < argc; i++) {
+    if (strncmp(argv[i], "max=", 4) == 0) {
+      options.maxLength = std::strtoull(argv[i] + 4, nullptr, 10);
+    }
+    else if (strncmp(argv[i], "reps=", 5) == 0) {
+      options.repetitions = std::max<uint32_t>(1, std::strtoul(argv[i] + 5, nullptr, 10));
+    }
+    else if (strcmp(argv[i], "u64") == 0) {
+      options.key64 = true;
+    }
+    else if (strcmp(argv[i], "narrow") == 0) {
+      options.narrowKeyRange = true;
+    }
+    else if (strcmp(argv[i], "stages") == 0) {
+      options.stageTimestamps = true;
+    }
+    else if (strncmp(argv[i], "engines=", 8) == 0) {
+      options.engines.clear();
+      std::string list = argv[i] + 8;
+      for (size_t start = 0; start <= list.size();) {
+        size_t end = std::min(list.find(',', start), list.size());
+        options.engines.push_back(list.substr(start, end - start));
+        start = end + 1;
+      }
+    }
+    else if (strncmp(argv[i], "out=", 4) == 0) {
+      options.outputPath = argv[i] + 4;
+    }
+  }
+
+  return options.key64 ? benchmark<uint64_t>(options) : benchmark<uint32_t>(options);
+}
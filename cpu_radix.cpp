@@ -3,12 +3,17 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <string.h>
 #include <chrono>
 #include <memory>
-#include <algorithm>
 #include <iostream>
+#include <vector>
+#include <thread>
+
+#include "cpu_radix.h"
+#include "mapped_file.h"
 
 // Generates predetermined random 32 bit numbers
 #define znew   (z=36969*(z&65535)+(z>>16))
@@ -16,7 +21,8 @@
 #define MWC    ((znew<<16)+wnew )
 static unsigned long z = 362436069, w = 521288629;
 
-bool checkSorted(int *array, size_t count) {
+template<typename T>
+bool checkSorted(T *array, size_t count) {
   size_t previous = 0;
   for (size_t i = 0; i < count; i++) {
     if (previous == i) {
@@ -30,16 +36,6 @@ bool checkSorted(int *array, size_t count) {
   return true;
 }
 
-void inPlacePrefixSum(int *buckets, size_t elements) {
-  // prefix sum
-  int previous = 0;
-  for (size_t i = 0; i < elements; ++i) {
-    int temp = buckets[i];
-    buckets[i] = previous;
-    previous += temp;
-  }
-}
-
 int comp(const void *a, const void *b) {
   int diff = *(int *) a - *(int *) b;
   if (diff < 0) return -1;
@@ -47,61 +43,134 @@ int comp(const void *a, const void *b) {
   return 0;
 }
 
-int main(int argc, char **argv) {
-  short maxBits = 32;
-  size_t elements = 678;
-  short radixBits = 4;
+template<typename T>
+T randomKey();
 
-  int *unsorted = (int *) _malloca(elements * sizeof(int));
-  for (size_t i = 0; i < elements; ++i) {
-    unsorted[i] = abs((int) MWC);
-//    unsorted[i] = i;
-  }
-  int *sorted = (int *) _malloca(elements * sizeof(int));
-  size_t counters = 1 << radixBits;
+template<>
+uint32_t randomKey<uint32_t>() {
+  return abs((int) MWC);
+}
 
-  int *buckets = new int[counters];
+template<>
+int32_t randomKey<int32_t>() {
+  return (int32_t) MWC;
+}
 
-  int passes = ceil((float) maxBits / (float) radixBits);
+template<>
+float randomKey<float>() {
+  return (float) (int32_t) MWC / 65536.0f;
+}
 
-  auto start = std::chrono::high_resolution_clock::now();
+template<>
+uint64_t randomKey<uint64_t>() {
+  uint64_t high = (uint32_t) MWC;
+  return high << 32 | (uint32_t) MWC;
+}
 
-  int mask = (1 << radixBits) - 1; // mask for each pass
-  for (size_t pass = 0; pass < passes; ++pass) {
-    memset(buckets, 0, counters * sizeof(int)); // reset buckets
-    // count radix occurrences
-    for (size_t i = 0; i < elements; ++i) {
-      int bucketIdx = (unsorted[i] & mask) >> (pass * radixBits);
-      ++buckets[bucketIdx];
-    }
+template<>
+int64_t randomKey<int64_t>() {
+  return (int64_t) randomKey<uint64_t>();
+}
 
-    inPlacePrefixSum(buckets, counters);
+template<>
+double randomKey<double>() {
+  return (double) randomKey<int64_t>() / 65536.0;
+}
 
-    if(pass == 0) {
-      std::cout << "Histogram: [" << std::endl;
-      for (size_t i = 0; i < counters; ++i) {
-        std::cout << buckets[i] << ", ";
-      }
-      std::cout << std::endl << "]" << std::endl;
-    }
+template<typename T>
+int sortRandomKeys(CpuRadixSorter &sorter, size_t elements, bool inPlace) {
+  T *unsorted = (T *) _malloca(elements * sizeof(T));
+  for (size_t i = 0; i < elements; ++i) {
+    unsorted[i] = randomKey<T>();
+  }
+  T *scratch = inPlace ? nullptr : (T *) _malloca(elements * sizeof(T));
 
-    for (size_t i = 0; i < elements; ++i) {
-      int bitChunk = (unsorted[i] & mask) >> (pass * radixBits);
-      int chunkSortPosition = buckets[bitChunk]++; // increase the position of the same bitchunk if we encounter it again
-      sorted[chunkSortPosition] = unsorted[i];
-    }
+  auto start = std::chrono::high_resolution_clock::now();
 
-    memcpy(unsorted, sorted, elements * sizeof(int));
-    mask = mask << radixBits; // next pass mask
+  if (inPlace) {
+    sorter.sortInPlace(unsorted, elements);
+  }
+  else {
+    sorter.sort(unsorted, scratch, elements);
   }
-
 
   auto stop = std::chrono::high_resolution_clock::now();
 
-  printf(checkSorted(sorted, elements) ? "SORTED\n" : "UNSORTED\n");
+  printf(checkSorted(unsorted, elements) ? "SORTED\n" : "UNSORTED\n");
   printf("In %d millis", std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count());
   _freea(unsorted);
-  _freea(sorted);
+  if (scratch != nullptr) {
+    _freea(scratch);
+  }
+
+  return 0;
+}
+
+// Sorts a file of raw native-endian keys inside its memory mapping, only the scratch half is allocated
+// and not even that in place
+template<typename T>
+int sortMappedKeys(CpuRadixSorter &sorter, const char *path, bool inPlace) {
+  MappedFile file(path);
+  T *keys = (T *) file.data();
+  const size_t elements = file.size() / sizeof(T);
+  std::vector<T> scratch(inPlace ? 0 : elements);
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  if (inPlace) {
+    sorter.sortInPlace(keys, elements);
+  }
+  else {
+    sorter.sort(keys, scratch.data(), elements);
+  }
+
+  auto stop = std::chrono::high_resolution_clock::now();
+
+  printf(checkSorted(keys, elements) ? "SORTED\n" : "UNSORTED\n");
+  printf("%zu keys in %d millis", elements, (int) std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count());
 
   return 0;
 }
+
+template<typename T>
+int sortKeys(CpuRadixSorter &sorter, const char *inputPath, size_t elements, bool inPlace) {
+  return inputPath != nullptr ? sortMappedKeys<T>(sorter, inputPath, inPlace) : sortRandomKeys<T>(sorter, elements, inPlace);
+}
+
+// Usage: cpu_radix [elements|in=<key file>] [threads] [u32|i32|f32|u64|i64|f64] [narrow|inplace]
+// in= sorts the file in place instead of random keys, inplace sorts without a scratch array
+int main(int argc, char **argv) {
+  const char *inputPath = argc > 1 && strncmp(argv[1], "in=", 3) == 0 ? argv[1] + 3 : nullptr;
+  size_t elements = argc > 1 && inputPath == nullptr ? std::strtoull(argv[1], nullptr, 10) : 678;
+  uint32_t threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+  const char *keyType = argc > 3 ? argv[3] : "u32";
+  bool narrowKeyRange = argc > 4 && strcmp(argv[4], "narrow") == 0;
+  bool inPlace = argc > 4 && strcmp(argv[4], "inplace") == 0;
+  short radixBits = 4;
+
+  ThreadPool pool(threads);
+  CpuRadixSorter sorter(pool, radixBits, narrowKeyRange);
+  if (inputPath != nullptr) {
+    printf("Sorting %s keys of %s with %u threads\n", keyType, inputPath, pool.size());
+  }
+  else {
+    printf("Sorting %zu %s keys with %u threads\n", elements, keyType, pool.size());
+  }
+
+  if (strcmp(keyType, "i32") == 0) {
+    return sortKeys<int32_t>(sorter, inputPath, elements, inPlace);
+  }
+  if (strcmp(keyType, "f32") == 0) {
+    return sortKeys<float>(sorter, inputPath, elements, inPlace);
+  }
+  if (strcmp(keyType, "u64") == 0) {
+    return sortKeys<uint64_t>(sorter, inputPath, elements, inPlace);
+  }
+  if (strcmp(keyType, "i64") == 0) {
+    return sortKeys<int64_t>(sorter, inputPath, elements, inPlace);
+  }
+  if (strcmp(keyType, "f64") == 0) {
+    return sortKeys<double>(sorter, inputPath, elements, inPlace);
+  }
+  return sortKeys<uint32_t>(sorter, inputPath, elements, inPlace);
+}
@@ -0,0 +1,977 @@
+//
+// Parallel LSD radix sort on the CPU, header only so cpu_radix.cpp and the benchmark share it
+//
+
+#ifndef RADIXCOMPUTE_CPU_RADIX_H
+#define RADIXCOMPUTE_CPU_RADIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <type_traits>
+#include <limits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RADIX_STREAM_STORES
+#endif
+
+// The AVX2 and AVX-512 histogram kernels are compiled for their instruction sets regardless of the
+// build flags and only run when the CPU reports them
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define RADIX_SIMD_HISTOGRAM
+#ifdef _MSC_VER
+#include <intrin.h>
+#define RADIX_TARGET_AVX2
+#define RADIX_TARGET_AVX512
+#else
+#define RADIX_TARGET_AVX2 __attribute__((target("avx2")))
+#define RADIX_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+// Below this many keys per worker the wake-up cost of a thread outweighs its share of the work
+#define MIN_ELEMENTS_PER_THREAD 65536
+
+// Upper bound for the threads x threads x counters table that the scatter fills with the
+// counts of the next pass. Above it the next pass counts its digits with a separate read.
+#define MAX_SCATTER_COUNTERS (1 << 20)
+
+// Scatters into arrays of at least this many bytes stage their keys in cache line buffers and write
+// whole lines with non-temporal stores. Smaller arrays stay cached between passes, where streaming
+// stores would only evict them.
+#define WRITE_COMBINE_MIN_BYTES (16 << 20)
+#define CACHE_LINE_SIZE 64
+
+// Copies of every histogram that consecutive keys count into round robin, so runs of equal digits
+// do not wait on the store of the previous increment
+#define SUB_HISTOGRAMS 4
+
+// Up to this many keys an insertion sort beats any radix pass
+#define SMALL_SORT_THRESHOLD 32
+// Up to this many keys a single threaded MSD radix sort replaces the parallel LSD passes.
+// Only one thread would be active below MIN_ELEMENTS_PER_THREAD anyway.
+#define MSD_SORT_THRESHOLD MIN_ELEMENTS_PER_THREAD
+// bits per MSD digit, a 256 entry histogram fits the stack of every recursion level
+#define MSD_RADIX_BITS 8
+
+/**
+ * Fixed set of worker threads that is created once and reused for every
+ * histogram and scatter step. The calling thread takes part as worker 0 so
+ * a pool of N threads only spawns N - 1 OS threads.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(uint32_t threadCount) : threadCount(std::max(threadCount, 1u)) {
+    for (uint32_t i = 1; i < this->threadCount; i++) {
+      workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeCondition.notify_all();
+    for (auto &worker: workers) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  uint32_t size() const {
+    return threadCount;
+  }
+
+  // Runs task(threadIdx) once for every threadIdx in [0, size()) and blocks until all of them return
+  void run(const std::function<void(uint32_t)> &task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      currentTask = &task;
+      pending = threadCount - 1;
+      generation++;
+    }
+    wakeCondition.notify_all();
+
+    task(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this] { return pending == 0; });
+    currentTask = nullptr;
+  }
+
+private:
+  void workerLoop(uint32_t threadIdx) {
+    uint64_t seenGeneration = 0;
+    while (true) {
+      const std::function<void(uint32_t)> *task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+        if (stopping) {
+          return;
+        }
+        seenGeneration = generation;
+        task = currentTask;
+      }
+
+      (*task)(threadIdx);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending == 0) {
+        doneCondition.notify_one();
+      }
+    }
+  }
+
+  const uint32_t threadCount;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wakeCondition;
+  std::condition_variable doneCondition;
+  const std::function<void(uint32_t)> *currentTask = nullptr;
+  uint64_t generation = 0;
+  uint32_t pending = 0;
+  bool stopping = false;
+};
+
+struct alignas(CACHE_LINE_SIZE) CacheLine {
+  unsigned char bytes[CACHE_LINE_SIZE];
+};
+
+/**
+ * Software write-combining for one thread's scatter. Every digit stages its keys in a line buffer
+ * that mirrors the cache line of the destination, and a full line goes to memory in one streaming
+ * store. The scatter then writes whole lines to counters streams instead of single keys to random
+ * addresses, so the cache and TLB are not thrashed once the arrays exceed the last level cache.
+ */
+template<typename U>
+class WriteCombiner {
+public:
+  static constexpr size_t LINE_KEYS = CACHE_LINE_SIZE / sizeof(U);
+
+  // starts holds the first destination position of every digit, lines one buffer per digit
+  WriteCombiner(U *sorted, CacheLine *lines, const size_t *starts) :
+      sorted(sorted), lines(lines), starts(starts), skew(((uintptr_t) sorted / sizeof(U)) % LINE_KEYS) {
+  }
+
+  void put(size_t digit, size_t position, U key) {
+    const size_t slot = (position + skew) % LINE_KEYS;
+    ((U *) lines[digit].bytes)[slot] = key;
+    if (slot == LINE_KEYS - 1) {
+      flush(digit, position + 1);
+    }
+  }
+
+  // Writes the lines the digits did not fill, ends holds the position after the last key of every digit
+  void finish(const size_t *ends, size_t counters) {
+    for (size_t digit = 0; digit < counters; ++digit) {
+      if (ends[digit] > starts[digit] && (ends[digit] + skew) % LINE_KEYS != 0) {
+        flush(digit, ends[digit]);
+      }
+    }
+#ifdef RADIX_STREAM_STORES
+    _mm_sfence(); // streaming stores are weakly ordered, the next pass reads them from other threads
+#endif
+  }
+
+private:
+  // Writes the staged keys of the line that ends right before end. Lines at the edges of the digit's
+  // range are shared with other digits or threads and only get their own keys written.
+  void flush(size_t digit, size_t end) {
+    const size_t used = (end + skew - 1) % LINE_KEYS + 1;
+    const size_t count = std::min(used, end - starts[digit]);
+    const U *line = (const U *) lines[digit].bytes;
+#ifdef RADIX_STREAM_STORES
+    if (count == LINE_KEYS) {
+      __m128i *dst = (__m128i *) (sorted + end - LINE_KEYS);
+      for (size_t i = 0; i < CACHE_LINE_SIZE / sizeof(__m128i); ++i) {
+        _mm_stream_si128(dst + i, _mm_load_si128((const __m128i *) line + i));
+      }
+      return;
+    }
+#endif
+    memcpy(sorted + end - count, line + used - count, count * sizeof(U));
+  }
+
+  U *sorted;
+  CacheLine *lines;
+  const size_t *starts;
+  size_t skew;
+};
+
+enum class KeyEncoding {
+  UNSIGNED,
+  SIGNED,
+  FLOAT
+};
+
+// Order preserving bit transforms over the unsigned storage type U of the keys. Keys are encoded while
+// they are read in the first pass and decoded while they are written in the last one, so no extra
+// pass over memory is needed.
+template<typename U>
+struct KeepBits {
+  static U apply(U key) { return key; }
+};
+
+template<typename U>
+constexpr U signBit = (U) 1 << (sizeof(U) * 8 - 1);
+
+// two's complement -> offset binary
+template<typename U>
+struct FlipSignBit {
+  static U apply(U key) { return key ^ signBit<U>; }
+};
+
+// negative floats get all bits flipped so larger magnitudes sort first, positive floats only the sign
+template<typename U>
+struct EncodeFloat {
+  static U apply(U key) { return key ^ ((U) -(std::make_signed_t<U>) (key >> (sizeof(U) * 8 - 1)) | signBit<U>); }
+};
+
+template<typename U>
+struct DecodeFloat {
+  static U apply(U key) { return key ^ (((key >> (sizeof(U) * 8 - 1)) - 1) | signBit<U>); }
+};
+
+// HISTOGRAM KERNELS
+// Count the digits of passes consecutive passes, the first one at bit firstShift, of the keys
+// [begin, end) after Load and the subtraction of bias. counts holds SUB_HISTOGRAMS copies of
+// passes x counters buckets that the caller adds up.
+enum class SimdLevel {
+  SCALAR,
+  AVX2,
+  AVX512
+};
+
+inline SimdLevel detectSimdLevel() {
+#ifdef RADIX_SIMD_HISTOGRAM
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return SimdLevel::SCALAR;
+  }
+  __cpuid(info, 1);
+  const bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+  const bool osSavesZmm = osSavesYmm && (_xgetbv(0) & 0xE0) == 0xE0;
+  __cpuidex(info, 7, 0);
+  if (osSavesZmm && (info[1] & (1 << 16))) {
+    return SimdLevel::AVX512;
+  }
+  if (osSavesYmm && (info[1] & (1 << 5))) {
+    return SimdLevel::AVX2;
+  }
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return SimdLevel::AVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+#endif
+#endif
+  return SimdLevel::SCALAR;
+}
+
+template<typename Load, typename U>
+void countDigitsScalar(const U *keys, size_t begin, size_t end, U bias, uint32_t firstShift, int passes, uint32_t bits,
+                       size_t counters, size_t *counts) {
+  const U mask = counters - 1;
+  const size_t histogramSize = passes * counters;
+  for (size_t i = begin; i < end; ++i) {
+    U key = (Load::apply(keys[i]) - bias) >> firstShift;
+    size_t *buckets = &counts[(i % SUB_HISTOGRAMS) * histogramSize];
+    for (int pass = 0; pass < passes; ++pass, key >>= bits) {
+      ++buckets[pass * counters + (key & mask)];
+    }
+  }
+}
+
+#ifdef RADIX_SIMD_HISTOGRAM
+// The vector kernels compute the digits of a whole register with shifts and masks, the increments
+// stay scalar since lanes with the same digit would conflict
+template<typename Load, typename U>
+RADIX_TARGET_AVX2 inline __m256i encodeAvx2(__m256i keys) {
+  const __m256i sign = sizeof(U) == 4 ? _mm256_set1_epi32(INT32_MIN) : _mm256_set1_epi64x(INT64_MIN);
+  if constexpr (std::is_same_v<Load, KeepBits<U>>) {
+    return keys;
+  }
+  else if constexpr (std::is_same_v<Load, FlipSignBit<U>>) {
+    return _mm256_xor_si256(keys, sign);
+  }
+  else { // EncodeFloat, the sign bit spread over the word selects the full flip
+    const __m256i negative = sizeof(U) == 4 ? _mm256_srai_epi32(keys, 31) : _mm256_cmpgt_epi64(_mm256_setzero_si256(), keys);
+    return _mm256_xor_si256(keys, _mm256_or_si256(negative, sign));
+  }
+}
+
+template<typename Load, typename U>
+RADIX_TARGET_AVX2 void countDigitsAvx2(const U *keys, size_t begin, size_t end, U bias, uint32_t firstShift, int passes, uint32_t bits,
+                                       size_t counters, size_t *counts) {
+  constexpr size_t LANES = sizeof(__m256i) / sizeof(U);
+  const size_t histogramSize = passes * counters;
+  const bool key32 = sizeof(U) == 4;
+  const __m256i biasVector = key32 ? _mm256_set1_epi32((int32_t) bias) : _mm256_set1_epi64x((int64_t) bias);
+  const __m256i mask = key32 ? _mm256_set1_epi32((int32_t) counters - 1) : _mm256_set1_epi64x((int64_t) counters - 1);
+  alignas(sizeof(__m256i)) U digits[LANES];
+  size_t i = begin;
+  for (; i + LANES <= end; i += LANES) {
+    __m256i key = encodeAvx2<Load, U>(_mm256_loadu_si256((const __m256i *) (keys + i)));
+    key = key32 ? _mm256_sub_epi32(key, biasVector) : _mm256_sub_epi64(key, biasVector);
+    for (int pass = 0; pass < passes; ++pass) {
+      const __m128i shift = _mm_cvtsi32_si128(firstShift + pass * bits);
+      const __m256i digit = _mm256_and_si256(key32 ? _mm256_srl_epi32(key, shift) : _mm256_srl_epi64(key, shift), mask);
+      _mm256_store_si256((__m256i *) digits, digit);
+      size_t *buckets = &counts[pass * counters];
+      for (size_t lane = 0; lane < LANES; ++lane) {
+        ++buckets[(lane % SUB_HISTOGRAMS) * histogramSize + digits[lane]];
+      }
+    }
+  }
+  countDigitsScalar<Load>(keys, i, end, bias, firstShift, passes, bits, counters, counts);
+}
+
+template<typename Load, typename U>
+RADIX_TARGET_AVX512 inline __m512i encodeAvx512(__m512i keys) {
+  const __m512i sign = sizeof(U) == 4 ? _mm512_set1_epi32(INT32_MIN) : _mm512_set1_epi64(INT64_MIN);
+  if constexpr (std::is_same_v<Load, KeepBits<U>>) {
+    return keys;
+  }
+  else if constexpr (std::is_same_v<Load, FlipSignBit<U>>) {
+    return _mm512_xor_si512(keys, sign);
+  }
+  else {
+    const __m512i negative = sizeof(U) == 4 ? _mm512_srai_epi32(keys, 31) : _mm512_srai_epi64(keys, 63);
+    return _mm512_xor_si512(keys, _mm512_or_si512(negative, sign));
+  }
+}
+
+template<typename Load, typename U>
+RADIX_TARGET_AVX512 void countDigitsAvx512(const U *keys, size_t begin, size_t end, U bias, uint32_t firstShift, int passes, uint32_t bits,
+                                           size_t counters, size_t *counts) {
+  constexpr size_t LANES = sizeof(__m512i) / sizeof(U);
+  const size_t histogramSize = passes * counters;
+  const bool key32 = sizeof(U) == 4;
+  const __m512i biasVector = key32 ? _mm512_set1_epi32((int32_t) bias) : _mm512_set1_epi64((int64_t) bias);
+  const __m512i mask = key32 ? _mm512_set1_epi32((int32_t) counters - 1) : _mm512_set1_epi64((int64_t) counters - 1);
+  alignas(sizeof(__m512i)) U digits[LANES];
+  size_t i = begin;
+  for (; i + LANES <= end; i += LANES) {
+    __m512i key = encodeAvx512<Load, U>(_mm512_loadu_si512((const void *) (keys + i)));
+    key = key32 ? _mm512_sub_epi32(key, biasVector) : _mm512_sub_epi64(key, biasVector);
+    for (int pass = 0; pass < passes; ++pass) {
+      const __m128i shift = _mm_cvtsi32_si128(firstShift + pass * bits);
+      const __m512i digit = _mm512_and_si512(key32 ? _mm512_srl_epi32(key, shift) : _mm512_srl_epi64(key, shift), mask);
+      _mm512_store_si512((void *) digits, digit);
+      size_t *buckets = &counts[pass * counters];
+      for (size_t lane = 0; lane < LANES; ++lane) {
+        ++buckets[(lane % SUB_HISTOGRAMS) * histogramSize + digits[lane]];
+      }
+    }
+  }
+  countDigitsScalar<Load>(keys, i, end, bias, firstShift, passes, bits, counters, counts);
+}
+#endif
+
+template<typename Load, typename U>
+void countDigits(SimdLevel level, const U *keys, size_t begin, size_t end, U bias, uint32_t firstShift, int passes, uint32_t bits,
+                 size_t counters, size_t *counts) {
+#ifdef RADIX_SIMD_HISTOGRAM
+  if (level == SimdLevel::AVX512) {
+    countDigitsAvx512<Load>(keys, begin, end, bias, firstShift, passes, bits, counters, counts);
+    return;
+  }
+  if (level == SimdLevel::AVX2) {
+    countDigitsAvx2<Load>(keys, begin, end, bias, firstShift, passes, bits, counters, counts);
+    return;
+  }
+#endif
+  countDigitsScalar<Load>(keys, begin, end, bias, firstShift, passes, bits, counters, counts);
+}
+// HISTOGRAM KERNELS - END
+
+/**
+ * Parallel LSD radix sort. Every pass is split in three steps:
+ * 1. each worker counts the digits of its own contiguous chunk into a private histogram
+ * 2. a single thread turns the (thread x digit) histograms into exclusive scatter offsets
+ *    ordered digit-major, thread-minor, so chunk t writes right after chunk t - 1 inside every bucket
+ * 3. each worker scatters its chunk to its private offsets, which keeps the sort stable without any atomics
+ */
+class CpuRadixSorter {
+public:
+  // With narrowKeyRange a min/max read runs first and only the bits in which the keys differ are sorted
+  CpuRadixSorter(ThreadPool &pool, short radixBits, bool narrowKeyRange = false) :
+      pool(pool), radixBits(radixBits), narrowKeyRange(narrowKeyRange), counters(1 << radixBits),
+      histograms(pool.size() * counters), destinations(pool.size() * counters), destinationEnds(pool.size() * counters),
+      simdLevel(detectSimdLevel()) {
+  }
+
+  // Histogram kernel picked from the CPU features. Forcing one the CPU lacks is undefined behavior.
+  SimdLevel histogramKernel() const {
+    return simdLevel;
+  }
+
+  void setHistogramKernel(SimdLevel level) {
+    simdLevel = level;
+  }
+
+  // Sorts keys in place. scratch must hold at least elements keys and its content is clobbered.
+  void sort(uint32_t *keys, uint32_t *scratch, size_t elements) {
+    sortBits(keys, scratch, elements, KeyEncoding::UNSIGNED);
+  }
+
+  void sort(int32_t *keys, int32_t *scratch, size_t elements) {
+    sortBits((uint32_t *) keys, (uint32_t *) scratch, elements, KeyEncoding::SIGNED);
+  }
+
+  void sort(float *keys, float *scratch, size_t elements) {
+    sortBits((uint32_t *) keys, (uint32_t *) scratch, elements, KeyEncoding::FLOAT);
+  }
+
+  void sort(uint64_t *keys, uint64_t *scratch, size_t elements) {
+    sortBits(keys, scratch, elements, KeyEncoding::UNSIGNED);
+  }
+
+  void sort(int64_t *keys, int64_t *scratch, size_t elements) {
+    sortBits((uint64_t *) keys, (uint64_t *) scratch, elements, KeyEncoding::SIGNED);
+  }
+
+  void sort(double *keys, double *scratch, size_t elements) {
+    sortBits((uint64_t *) keys, (uint64_t *) scratch, elements, KeyEncoding::FLOAT);
+  }
+
+  // Sorts keys in place with an American flag MSD radix sort that needs no scratch array, only
+  // 2^MSD_RADIX_BITS counters per recursion level. Slower than sort() but it halves the memory.
+  void sortInPlace(uint32_t *keys, size_t elements) {
+    sortBitsInPlace(keys, elements, KeyEncoding::UNSIGNED);
+  }
+
+  void sortInPlace(int32_t *keys, size_t elements) {
+    sortBitsInPlace((uint32_t *) keys, elements, KeyEncoding::SIGNED);
+  }
+
+  void sortInPlace(float *keys, size_t elements) {
+    sortBitsInPlace((uint32_t *) keys, elements, KeyEncoding::FLOAT);
+  }
+
+  void sortInPlace(uint64_t *keys, size_t elements) {
+    sortBitsInPlace(keys, elements, KeyEncoding::UNSIGNED);
+  }
+
+  void sortInPlace(int64_t *keys, size_t elements) {
+    sortBitsInPlace((uint64_t *) keys, elements, KeyEncoding::SIGNED);
+  }
+
+  void sortInPlace(double *keys, size_t elements) {
+    sortBitsInPlace((uint64_t *) keys, elements, KeyEncoding::FLOAT);
+  }
+
+private:
+  template<typename U>
+  void sortBits(U *keys, U *scratch, size_t elements, KeyEncoding encoding) {
+    switch (encoding) {
+      case KeyEncoding::UNSIGNED:
+        sortEncoded<KeepBits<U>, KeepBits<U>>(keys, scratch, elements);
+        break;
+      case KeyEncoding::SIGNED:
+        sortEncoded<FlipSignBit<U>, FlipSignBit<U>>(keys, scratch, elements);
+        break;
+      case KeyEncoding::FLOAT:
+        sortEncoded<EncodeFloat<U>, DecodeFloat<U>>(keys, scratch, elements);
+        break;
+    }
+  }
+
+  template<typename U>
+  void sortBitsInPlace(U *keys, size_t elements, KeyEncoding encoding) {
+    switch (encoding) {
+      case KeyEncoding::UNSIGNED:
+        americanFlagSort<KeepBits<U>>(keys, elements);
+        break;
+      case KeyEncoding::SIGNED:
+        americanFlagSort<FlipSignBit<U>>(keys, elements);
+        break;
+      case KeyEncoding::FLOAT:
+        americanFlagSort<EncodeFloat<U>>(keys, elements);
+        break;
+    }
+  }
+
+  template<typename Encode, typename Decode, typename U>
+  void sortEncoded(U *keys, U *scratch, size_t elements) {
+    const short maxBits = sizeof(U) * 8;
+    if (elements <= MSD_SORT_THRESHOLD) {
+      msdSort<Encode>(keys, scratch, elements, maxBits);
+      return;
+    }
+
+    const uint32_t threads = activeThreads(elements);
+    // a single thread can take every pass straight from the upfront counts,
+    // several threads need the per-chunk counts that the previous scatter collects
+    const bool countOnScatter = threads > 1 && (size_t) threads * threads * counters <= MAX_SCATTER_COUNTERS;
+
+    // keys are sorted as Encode(key) - bias, which only has rangeBits significant bits
+    U bias = 0;
+    short rangeBits = maxBits;
+    if (narrowKeyRange && elements > 0) {
+      auto [low, high] = keyRange<Encode>(keys, elements, threads);
+      bias = low;
+      rangeBits = 0;
+      for (U range = high - low; range != 0; range >>= 1) {
+        ++rangeBits;
+      }
+    }
+    const int passes = ceil((float) rangeBits / (float) radixBits);
+
+    countAllDigits<Encode>(keys, elements, passes, threads, bias);
+    if (countOnScatter) {
+      nextCounts.resize((size_t) threads * threads * counters);
+    }
+
+    // a digit that puts every key into the same bucket would only copy the keys
+    std::vector<int> sortedPasses;
+    for (int pass = 0; pass < passes; ++pass) {
+      bool uniform = false;
+      for (size_t digit = 0; digit < counters && !uniform; ++digit) {
+        size_t total = 0;
+        for (uint32_t t = 0; t < threads; ++t) {
+          total += digitCounts[((size_t) t * passes + pass) * counters + digit];
+        }
+        uniform = total == elements;
+      }
+      if (!uniform) {
+        sortedPasses.push_back(pass);
+      }
+    }
+
+    U *unsorted = keys;
+    U *sorted = scratch;
+    for (size_t i = 0; i < sortedPasses.size(); ++i) {
+      const bool first = i == 0;
+      const bool last = i + 1 == sortedPasses.size();
+      const int pass = sortedPasses[i];
+      const int nextPass = last || !countOnScatter ? -1 : sortedPasses[i + 1];
+      loadPassCounts(unsorted, elements, pass, threads, first, countOnScatter);
+      runCodedPass<Encode, Decode>(unsorted, sorted, elements, pass, nextPass, threads, first, last,
+                                   first ? bias : 0, last ? bias : 0);
+
+      std::swap(unsorted, sorted); // ping-pong instead of copying the whole array back every pass
+    }
+
+    if (unsorted != keys) { // odd number of passes
+      memcpy(keys, unsorted, elements * sizeof(U));
+    }
+  }
+
+  // Sorts by the encoded bits below endBit, all higher bits are equal. Every level scatters the keys into
+  // 2^MSD_RADIX_BITS buckets through scratch and recurses into them, buckets of up to
+  // SMALL_SORT_THRESHOLD keys are finished with an insertion sort.
+  template<typename Encode, typename U>
+  static void msdSort(U *keys, U *scratch, size_t elements, int endBit) {
+    const size_t buckets = 1 << MSD_RADIX_BITS;
+    while (elements > SMALL_SORT_THRESHOLD && endBit > 0) {
+      const int shift = std::max(endBit - MSD_RADIX_BITS, 0);
+      const U mask = ((U) 1 << (endBit - shift)) - 1;
+      size_t counts[buckets] = {};
+      for (size_t i = 0; i < elements; ++i) {
+        ++counts[(Encode::apply(keys[i]) >> shift) & mask];
+      }
+      endBit = shift;
+      if (std::find(counts, counts + buckets, elements) != counts + buckets) {
+        continue; // one bucket holds everything, go straight to the next digit
+      }
+
+      size_t offsets[buckets];
+      size_t sum = 0;
+      for (size_t digit = 0; digit < buckets; ++digit) {
+        offsets[digit] = sum;
+        sum += counts[digit];
+      }
+      for (size_t i = 0; i < elements; ++i) {
+        scratch[offsets[(Encode::apply(keys[i]) >> shift) & mask]++] = keys[i];
+      }
+      memcpy(keys, scratch, elements * sizeof(U));
+
+      size_t begin = 0;
+      for (size_t digit = 0; digit < buckets; ++digit) {
+        if (counts[digit] > 1) {
+          msdSort<Encode>(keys + begin, scratch + begin, counts[digit], shift);
+        }
+        begin += counts[digit];
+      }
+      return;
+    }
+    insertionSort<Encode>(keys, elements);
+  }
+
+  // The calling thread splits the largest buckets until each is a fraction of one thread's share,
+  // then the workers take the buckets largest first and finish them independently.
+  template<typename Encode, typename U>
+  void americanFlagSort(U *keys, size_t elements) {
+    struct Bucket {
+      size_t begin;
+      size_t elements;
+      int endBit;
+    };
+    const size_t share = std::max<size_t>(elements / ((size_t) pool.size() * 4), MSD_SORT_THRESHOLD);
+    std::vector<Bucket> pending = {{0, elements, (int) sizeof(U) * 8}};
+    std::vector<Bucket> ready;
+    while (!pending.empty()) {
+      const Bucket bucket = pending.back();
+      pending.pop_back();
+      if (bucket.elements <= share || bucket.endBit == 0 || pool.size() == 1) {
+        ready.push_back(bucket);
+        continue;
+      }
+      size_t counts[1 << MSD_RADIX_BITS];
+      const int shift = permuteBuckets<Encode>(keys + bucket.begin, bucket.elements, bucket.endBit, counts);
+      size_t begin = bucket.begin;
+      for (size_t count : counts) {
+        if (count > 1) {
+          pending.push_back({begin, count, shift});
+        }
+        begin += count;
+      }
+    }
+
+    std::sort(ready.begin(), ready.end(), [](const Bucket &a, const Bucket &b) {
+      return a.elements > b.elements;
+    });
+    std::atomic<size_t> next = 0;
+    pool.run([&](uint32_t) {
+      for (size_t i = next++; i < ready.size(); i = next++) {
+        americanFlagBucket<Encode>(keys + ready[i].begin, ready[i].elements, ready[i].endBit);
+      }
+    });
+  }
+
+  template<typename Encode, typename U>
+  static void americanFlagBucket(U *keys, size_t elements, int endBit) {
+    if (elements <= SMALL_SORT_THRESHOLD || endBit == 0) {
+      insertionSort<Encode>(keys, elements);
+      return;
+    }
+    size_t counts[1 << MSD_RADIX_BITS];
+    const int shift = permuteBuckets<Encode>(keys, elements, endBit, counts);
+    size_t begin = 0;
+    for (size_t count : counts) {
+      if (count > 1) {
+        americanFlagBucket<Encode>(keys + begin, count, shift);
+      }
+      begin += count;
+    }
+  }
+
+  // One American flag step on the digit below endBit: count the digits, then swap every key into its
+  // bucket along the permutation cycles. Digits that leave all keys in one bucket are skipped.
+  // Returns the shift of the digit that was applied, counts receives its bucket sizes.
+  template<typename Encode, typename U>
+  static int permuteBuckets(U *keys, size_t elements, int endBit, size_t *counts) {
+    const size_t buckets = 1 << MSD_RADIX_BITS;
+    int shift;
+    U mask;
+    do {
+      shift = std::max(endBit - MSD_RADIX_BITS, 0);
+      mask = ((U) 1 << (endBit - shift)) - 1;
+      std::fill(counts, counts + buckets, 0);
+      for (size_t i = 0; i < elements; ++i) {
+        ++counts[(Encode::apply(keys[i]) >> shift) & mask];
+      }
+      endBit = shift;
+    } while (shift > 0 && std::find(counts, counts + buckets, elements) != counts + buckets);
+
+    size_t heads[buckets];
+    size_t tails[buckets];
+    size_t sum = 0;
+    for (size_t digit = 0; digit < buckets; ++digit) {
+      heads[digit] = sum;
+      sum += counts[digit];
+      tails[digit] = sum;
+    }
+    for (size_t digit = 0; digit < buckets; ++digit) {
+      while (heads[digit] < tails[digit]) {
+        U key = keys[heads[digit]];
+        size_t keyDigit = (Encode::apply(key) >> shift) & mask;
+        while (keyDigit != digit) { // carry the key to its bucket and pick up the one it displaces
+          std::swap(key, keys[heads[keyDigit]++]);
+          keyDigit = (Encode::apply(key) >> shift) & mask;
+        }
+        keys[heads[digit]++] = key;
+      }
+    }
+    return shift;
+  }
+
+  template<typename Encode, typename U>
+  static void insertionSort(U *keys, size_t elements) {
+    for (size_t i = 1; i < elements; ++i) {
+      const U key = keys[i];
+      const U encoded = Encode::apply(key);
+      size_t j = i;
+      for (; j > 0 && Encode::apply(keys[j - 1]) > encoded; --j) {
+        keys[j] = keys[j - 1];
+      }
+      keys[j] = key;
+    }
+  }
+
+  // Smallest and largest encoded key
+  template<typename Load, typename U>
+  std::pair<U, U> keyRange(const U *keys, size_t elements, uint32_t threads) {
+    std::vector<std::pair<U, U>> ranges(threads, {std::numeric_limits<U>::max(), 0});
+
+    pool.run([&](uint32_t threadIdx) {
+      if (threadIdx >= threads) {
+        return;
+      }
+      U low = std::numeric_limits<U>::max();
+      U high = 0;
+      const size_t end = chunkEnd(elements, threads, threadIdx);
+      for (size_t i = chunkBegin(elements, threads, threadIdx); i < end; ++i) {
+        U key = Load::apply(keys[i]);
+        low = std::min(low, key);
+        high = std::max(high, key);
+      }
+      ranges[threadIdx] = {low, high};
+    });
+
+    std::pair<U, U> range = ranges[0];
+    for (uint32_t t = 1; t < threads; ++t) {
+      range.first = std::min(range.first, ranges[t].first);
+      range.second = std::max(range.second, ranges[t].second);
+    }
+    return range;
+  }
+
+  // One read over the keys that counts the digits of every pass, per thread chunk
+  template<typename Load, typename U>
+  void countAllDigits(const U *keys, size_t elements, int passes, uint32_t threads, U bias) {
+    countedPasses = passes;
+    digitCounts.assign((size_t) threads * passes * counters, 0);
+
+    pool.run([&](uint32_t threadIdx) {
+      if (threadIdx >= threads) {
+        return;
+      }
+      const size_t histogramSize = passes * counters;
+      std::vector<size_t> subCounts(SUB_HISTOGRAMS * histogramSize);
+      countDigits<Load>(simdLevel, keys, chunkBegin(elements, threads, threadIdx), chunkEnd(elements, threads, threadIdx),
+                        bias, 0, passes, radixBits, counters, subCounts.data());
+      addSubHistograms(subCounts.data(), histogramSize, &digitCounts[(size_t) threadIdx * histogramSize]);
+    });
+  }
+
+  // Fills histograms with the per thread counts of this pass, without reading the keys if possible
+  template<typename U>
+  void loadPassCounts(const U *unsorted, size_t elements, int pass, uint32_t threads, bool first, bool countOnScatter) {
+    if (first || threads == 1) {
+      // the chunks of the first pass are the ones countAllDigits saw, and one thread owns everything anyway
+      for (uint32_t t = 0; t < threads; ++t) {
+        memcpy(&histograms[t * counters], &digitCounts[((size_t) t * countedPasses + pass) * counters], counters * sizeof(size_t));
+      }
+      return;
+    }
+
+    pool.run([&](uint32_t threadIdx) {
+      if (threadIdx >= threads) {
+        return;
+      }
+      size_t *buckets = &histograms[threadIdx * counters];
+      memset(buckets, 0, counters * sizeof(size_t)); // reset buckets
+      if (countOnScatter) {
+        // sum what every scattering thread wrote into this chunk
+        for (uint32_t source = 0; source < threads; ++source) {
+          const size_t *counts = &nextCounts[((size_t) source * threads + threadIdx) * counters];
+          for (size_t digit = 0; digit < counters; ++digit) {
+            buckets[digit] += counts[digit];
+          }
+        }
+        return;
+      }
+      std::vector<size_t> subCounts(SUB_HISTOGRAMS * counters);
+      countDigits<KeepBits<U>>(simdLevel, unsorted, chunkBegin(elements, threads, threadIdx), chunkEnd(elements, threads, threadIdx),
+                               (U) 0, pass * radixBits, 1, radixBits, counters, subCounts.data());
+      addSubHistograms(subCounts.data(), counters, buckets);
+    });
+  }
+
+  static void addSubHistograms(const size_t *subCounts, size_t histogramSize, size_t *counts) {
+    for (size_t sub = 0; sub < SUB_HISTOGRAMS; ++sub) {
+      for (size_t i = 0; i < histogramSize; ++i) {
+        counts[i] += subCounts[sub * histogramSize + i];
+      }
+    }
+  }
+
+  // Picks the encode transform for the first pass and the decode transform for the last one
+  template<typename Encode, typename Decode, typename U>
+  void runCodedPass(const U *unsorted, U *sorted, size_t elements, int pass, int nextPass, uint32_t threads, bool first, bool last,
+                    U loadBias, U storeBias) {
+    if (first && last) {
+      runPass<Encode, Decode>(unsorted, sorted, elements, pass, nextPass, threads, loadBias, storeBias);
+    }
+    else if (first) {
+      runPass<Encode, KeepBits<U>>(unsorted, sorted, elements, pass, nextPass, threads, loadBias, storeBias);
+    }
+    else if (last) {
+      runPass<KeepBits<U>, Decode>(unsorted, sorted, elements, pass, nextPass, threads, loadBias, storeBias);
+    }
+    else {
+      runPass<KeepBits<U>, KeepBits<U>>(unsorted, sorted, elements, pass, nextPass, threads, loadBias, storeBias);
+    }
+  }
+
+  // Load and then the subtraction of loadBias are applied to every key that is read, the addition of
+  // storeBias and then Store to every key that is written.
+  // With nextPass >= 0 the scatter also counts that pass's digit per destination chunk into nextCounts.
+  template<typename Load, typename Store, typename U>
+  void runPass(const U *unsorted, U *sorted, size_t elements, int pass, int nextPass, uint32_t threads, U loadBias, U storeBias) {
+    const uint32_t shift = pass * radixBits;
+    const uint32_t nextShift = nextPass * radixBits;
+    const U mask = counters - 1;
+    const bool writeCombine = elements * sizeof(U) >= WRITE_COMBINE_MIN_BYTES;
+    if (writeCombine) {
+      combineLines.resize((size_t) threads * counters);
+      combineStarts.resize((size_t) threads * counters);
+    }
+
+    crossThreadPrefixSum(threads);
+
+    // combine is std::true_type or std::false_type, so both scatters compile without a branch per key
+    auto scatter = [&](uint32_t threadIdx, auto combine) {
+      size_t *offsets = &histograms[threadIdx * counters];
+      CacheLine *lines = nullptr;
+      size_t *starts = nullptr;
+      if constexpr (decltype(combine)::value) {
+        lines = &combineLines[threadIdx * counters];
+        starts = &combineStarts[threadIdx * counters];
+        memcpy(starts, offsets, counters * sizeof(size_t));
+      }
+      WriteCombiner<U> combiner(sorted, lines, starts);
+      auto store = [&](size_t digit, size_t position, U key) {
+        if constexpr (decltype(combine)::value) {
+          combiner.put(digit, position, key);
+        }
+        else {
+          sorted[position] = key;
+        }
+      };
+
+      const size_t end = chunkEnd(elements, threads, threadIdx);
+      if (nextPass < 0) {
+        for (size_t i = chunkBegin(elements, threads, threadIdx); i < end; ++i) {
+          U key = Load::apply(unsorted[i]) - loadBias;
+          size_t bitChunk = (key >> shift) & mask;
+          store(bitChunk, offsets[bitChunk]++, Store::apply(key + storeBias)); // increase the position of the same bitchunk if we encounter it again
+        }
+      }
+      else {
+        // every digit writes an increasing run of positions, so its destination chunk only ever moves forward
+        size_t *next = &nextCounts[(size_t) threadIdx * threads * counters];
+        uint32_t *dst = &destinations[threadIdx * counters];
+        size_t *dstEnd = &destinationEnds[threadIdx * counters];
+        memset(next, 0, (size_t) threads * counters * sizeof(size_t));
+        for (size_t digit = 0; digit < counters; ++digit) {
+          dst[digit] = chunkOf(elements, threads, offsets[digit]);
+          dstEnd[digit] = chunkEnd(elements, threads, dst[digit]);
+        }
+        for (size_t i = chunkBegin(elements, threads, threadIdx); i < end; ++i) {
+          U key = Load::apply(unsorted[i]) - loadBias;
+          size_t bitChunk = (key >> shift) & mask;
+          size_t position = offsets[bitChunk]++;
+          store(bitChunk, position, Store::apply(key + storeBias));
+          while (position >= dstEnd[bitChunk]) {
+            dstEnd[bitChunk] = chunkEnd(elements, threads, ++dst[bitChunk]);
+          }
+          ++next[dst[bitChunk] * counters + ((key >> nextShift) & mask)];
+        }
+      }
+      if constexpr (decltype(combine)::value) {
+        combiner.finish(offsets, counters);
+      }
+    };
+
+    pool.run([&](uint32_t threadIdx) {
+      if (threadIdx >= threads) {
+        return;
+      }
+      if (writeCombine) {
+        scatter(threadIdx, std::true_type());
+      }
+      else {
+        scatter(threadIdx, std::false_type());
+      }
+    });
+  }
+
+  uint32_t activeThreads(size_t elements) const {
+    size_t wanted = std::max<size_t>(elements / MIN_ELEMENTS_PER_THREAD, 1);
+    return (uint32_t) std::min<size_t>(wanted, pool.size());
+  }
+
+  static size_t chunkBegin(size_t elements, uint32_t threads, uint32_t threadIdx) {
+    return elements * threadIdx / threads;
+  }
+
+  static size_t chunkEnd(size_t elements, uint32_t threads, uint32_t threadIdx) {
+    return elements * (threadIdx + 1) / threads;
+  }
+
+  // Index of the chunk that holds position, positions past the end belong to the last chunk
+  static uint32_t chunkOf(size_t elements, uint32_t threads, size_t position) {
+    if (position >= elements) {
+      return threads - 1;
+    }
+    uint32_t chunk = position * threads / elements;
+    while (chunkEnd(elements, threads, chunk) <= position) {
+      ++chunk;
+    }
+    while (chunkBegin(elements, threads, chunk) > position) {
+      --chunk;
+    }
+    return chunk;
+  }
+
+  // Exclusive scan over the histograms in (digit, thread) order, written back in place
+  void crossThreadPrefixSum(uint32_t threads) {
+    size_t previous = 0;
+    for (size_t digit = 0; digit < counters; ++digit) {
+      for (uint32_t t = 0; t < threads; ++t) {
+        size_t temp = histograms[t * counters + digit];
+        histograms[t * counters + digit] = previous;
+        previous += temp;
+      }
+    }
+  }
+
+  ThreadPool &pool;
+  const short radixBits;
+  const bool narrowKeyRange;
+  const size_t counters;
+  std::vector<size_t> histograms; // threads x counters
+  std::vector<size_t> digitCounts; // threads x countedPasses x counters, from the upfront read
+  int countedPasses = 0;
+  std::vector<size_t> nextCounts; // source threads x destination chunks x counters
+  std::vector<uint32_t> destinations; // threads x counters, current destination chunk of every digit
+  std::vector<size_t> destinationEnds; // threads x counters
+  std::vector<CacheLine> combineLines; // threads x counters, staging lines of the write-combining scatter
+  std::vector<size_t> combineStarts; // threads x counters, first position of every digit in the scatter
+  SimdLevel simdLevel;
+};
+
+#endif //RADIXCOMPUTE_CPU_RADIX_H
@@ -0,0 +1,234 @@
+#include "external_sort.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <queue>
+#include <type_traits>
+#include <vector>
+
+static size_t readKeys(std::ifstream &file, void *keys, size_t keySize, size_t count) {
+  file.read((char *) keys, keySize * count);
+  return file.gcount() / keySize;
+}
+
+static void writeKeys(std::ofstream &file, const void *keys, size_t bytes, const std::string &path) {
+  file.write((const char *) keys, bytes);
+  if (!file) {
+    std::cout << "Failed to write " << path << std::endl;
+    exit(-1);
+  }
+}
+
+// Unsigned bits in sort order, so the merge agrees with the radix passes on negative zero and NaNs
+template<typename K, typename U = std::conditional_t<sizeof(K) == sizeof(uint64_t), uint64_t, uint32_t>>
+static U orderedBits(const K &key) {
+  U bits;
+  memcpy(&bits, &key, sizeof(U));
+  return encodeKeyBits(bits, RadixKeyTraits<K>::type);
+}
+
+ExternalRadixSorter::ExternalRadixSorter(RadixSorter &sorter, const ExternalSortConfig &config) :
+    sorter(sorter), config(config) {
+  if (config.runLength == 0) {
+    std::cout << "ExternalSortConfig::runLength must be positive" << std::endl;
+    exit(-1);
+  }
+}
+
+std::string ExternalRadixSorter::runPath(const std::string &outputPath, size_t run) const {
+  const std::string runName = std::filesystem::path(outputPath).filename().string() + ".run" + std::to_string(run);
+  return (std::filesystem::path(config.tempDir) / runName).string();
+}
+
+template<typename K>
+size_t ExternalRadixSorter::sortFile(const std::string &inputPath, const std::string &outputPath) {
+  std::error_code error;
+  const uintmax_t fileSize = std::filesystem::file_size(inputPath, error);
+  if (error || fileSize % sizeof(K) != 0) {
+    std::cout << "Cannot sort " << inputPath << ", it has to exist and hold whole keys of " << sizeof(K) << " bytes" << std::endl;
+    exit(-1);
+  }
+  const size_t length = fileSize / sizeof(K);
+  const size_t runCount = (length + config.runLength - 1) / config.runLength;
+
+  // SORT RUNS
+  // Three buffers rotate: while run i is sorted, run i + 1 is read and run i - 1 is written.
+  // A single run is written straight to the output and needs no merge.
+  std::ifstream input(inputPath, std::ios::binary);
+  std::vector<K> buffers[3];
+  for (std::vector<K> &buffer : buffers) {
+    buffer.resize(std::min(config.runLength, length));
+  }
+  auto runSize = [&](size_t run) {
+    return std::min(config.runLength, length - run * config.runLength);
+  };
+  auto readRun = [&](size_t run) {
+    return readKeys(input, buffers[run % 3].data(), sizeof(K), runSize(run));
+  };
+
+  std::future<size_t> read;
+  std::future<void> write;
+  if (runCount > 0) {
+    read = std::async(std::launch::async, readRun, 0);
+  }
+  for (size_t run = 0; run < runCount; run++) {
+    const size_t count = read.get();
+    if (count != runSize(run)) {
+      std::cout << "Failed to read " << inputPath << std::endl;
+      exit(-1);
+    }
+    if (run + 1 < runCount) {
+      read = std::async(std::launch::async, readRun, run + 1);
+    }
+
+    std::vector<K> &keys = buffers[run % 3];
+    sorter.sort(std::span<K>(keys.data(), count));
+
+    // the buffer of run i - 2 is read into next, so its write must be done before run i + 1 starts reading
+    if (write.valid()) {
+      write.get();
+    }
+    const std::string path = runCount == 1 ? outputPath : runPath(outputPath, run);
+    write = std::async(std::launch::async, [&keys, count, path] {
+      std::ofstream file(path, std::ios::binary | std::ios::trunc);
+      writeKeys(file, keys.data(), sizeof(K) * count, path);
+    });
+  }
+  if (write.valid()) {
+    write.get();
+  }
+  input.close();
+  // SORT RUNS - END
+
+  if (runCount == 0) { // an empty input still gets an empty output
+    std::ofstream file(outputPath, std::ios::binary | std::ios::trunc);
+  }
+  else if (runCount > 1) {
+    for (std::vector<K> &buffer : buffers) { // the merge only needs its small stream buffers
+      std::vector<K>().swap(buffer);
+    }
+    mergeRuns<K>(outputPath, runCount, length);
+  }
+  return length;
+}
+
+template<typename K>
+void ExternalRadixSorter::mergeRuns(const std::string &outputPath, size_t runCount, size_t length) {
+  typedef decltype(orderedBits(K())) U;
+  const size_t bufferLength = std::max<size_t>(1, config.mergeBufferSize / sizeof(K));
+
+  // Every run streams through two buffers: the merge consumes one while the next chunk is read into the other
+  struct Run {
+    std::ifstream file;
+    std::vector<K> buffers[2];
+    uint32_t current = 0;
+    size_t count = 0;
+    size_t position = 0;
+    std::future<size_t> prefetch;
+  };
+  auto startPrefetch = [&](Run &run) {
+    K *dst = run.buffers[run.current ^ 1].data();
+    run.prefetch = std::async(std::launch::async, [&run, dst, bufferLength] {
+      return readKeys(run.file, dst, sizeof(K), bufferLength);
+    });
+  };
+  // swaps in the prefetched chunk, an empty one means the run is exhausted
+  auto advance = [&](Run &run) {
+    run.count = run.prefetch.get();
+    run.current ^= 1;
+    run.position = 0;
+    if (run.count != 0) {
+      startPrefetch(run);
+    }
+  };
+
+  std::vector<Run> runs(runCount);
+  typedef std::pair<U, size_t> Head;
+  // smallest head first, equal keys leave the earlier run first
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+  for (size_t i = 0; i < runCount; i++) {
+    Run &run = runs[i];
+    const std::string path = runPath(outputPath, i);
+    run.file.open(path, std::ios::binary);
+    if (!run.file.is_open()) {
+      std::cout << "Failed to open " << path << std::endl;
+      exit(-1);
+    }
+    run.buffers[0].resize(bufferLength);
+    run.buffers[1].resize(bufferLength);
+    startPrefetch(run);
+  }
+  for (size_t i = 0; i < runCount; i++) {
+    Run &run = runs[i];
+    advance(run);
+    if (run.count != 0) {
+      heap.push({orderedBits(run.buffers[run.current][0]), i});
+    }
+  }
+
+  // the output is double buffered as well, one buffer fills while the other is written
+  std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+  std::vector<K> outBuffers[2] = {std::vector<K>(bufferLength), std::vector<K>(bufferLength)};
+  uint32_t outCurrent = 0;
+  size_t outCount = 0;
+  size_t merged = 0;
+  std::future<void> write;
+  auto flush = [&]() {
+    if (write.valid()) {
+      write.get();
+    }
+    const K *keys = outBuffers[outCurrent].data();
+    const size_t bytes = sizeof(K) * outCount;
+    write = std::async(std::launch::async, [&output, keys, bytes, &outputPath] {
+      writeKeys(output, keys, bytes, outputPath);
+    });
+    merged += outCount;
+    outCurrent ^= 1;
+    outCount = 0;
+  };
+
+  while (!heap.empty()) {
+    const size_t i = heap.top().second;
+    heap.pop();
+    Run &run = runs[i];
+    outBuffers[outCurrent][outCount++] = run.buffers[run.current][run.position++];
+    if (outCount == bufferLength) {
+      flush();
+    }
+    if (run.position == run.count) {
+      advance(run);
+    }
+    if (run.position < run.count) {
+      heap.push({orderedBits(run.buffers[run.current][run.position]), i});
+    }
+  }
+  if (outCount != 0) {
+    flush();
+  }
+  if (write.valid()) {
+    write.get();
+  }
+  output.close();
+  if (merged != length) {
+    std::cout << "Merged " << merged << " of " << length << " keys, the runs in " << config.tempDir << " are incomplete" << std::endl;
+    exit(-1);
+  }
+
+  for (size_t i = 0; i < runCount; i++) {
+    runs[i].file.close();
+    std::filesystem::remove(runPath(outputPath, i));
+  }
+}
+
+template size_t ExternalRadixSorter::sortFile<uint32_t>(const std::string &, const std::string &);
+template size_t ExternalRadixSorter::sortFile<int32_t>(const std::string &, const std::string &);
+template size_t ExternalRadixSorter::sortFile<float>(const std::string &, const std::string &);
+template size_t ExternalRadixSorter::sortFile<uint64_t>(const std::string &, const std::string &);
+template size_t ExternalRadixSorter::sortFile<int64_t>(const std::string &, const std::string &);
+template size_t ExternalRadixSorter::sortFile<double>(const std::string &, const std::string &);
@@ -0,0 +1,44 @@
+//
+// External radix sort for key files larger than host or device memory. The file is cut into
+// runs that are sorted by a RadixSorter and spilled to disk, then a k-way merge streams the
+// runs into the output file. Reads, sorts and writes of consecutive runs overlap.
+//
+
+#ifndef RADIXCOMPUTE_EXTERNAL_SORT_H
+#define RADIXCOMPUTE_EXTERNAL_SORT_H
+
+#include "radix_sorter.h"
+
+#include <stddef.h>
+#include <string>
+
+struct ExternalSortConfig {
+  // keys per run. Three runs are held in host memory at once (read, sorted, written) and
+  // one run has to fit the buffers of the RadixSorter.
+  size_t runLength = 1 << 26;
+  // directory for the sorted runs, which take as much space as the input
+  std::string tempDir = ".";
+  // bytes read ahead per run during the merge, twice per run since reads are double buffered
+  size_t mergeBufferSize = 4 << 20;
+};
+
+class ExternalRadixSorter {
+public:
+  explicit ExternalRadixSorter(RadixSorter &sorter, const ExternalSortConfig &config = ExternalSortConfig());
+
+  // Sorts the raw native-endian keys in inputPath into outputPath and returns the number of keys.
+  // The input has to be a whole number of keys. Implemented for all key types of RadixKeyTraits.
+  template<typename K>
+  size_t sortFile(const std::string &inputPath, const std::string &outputPath);
+
+private:
+  template<typename K>
+  void mergeRuns(const std::string &outputPath, size_t runCount, size_t length);
+
+  std::string runPath(const std::string &outputPath, size_t run) const;
+
+  RadixSorter &sorter;
+  ExternalSortConfig config;
+};
+
+#endif //RADIXCOMPUTE_EXTERNAL_SORT_H
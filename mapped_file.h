@@ -0,0 +1,113 @@
+//
+// Read-write memory mapping of a whole file, so keys can be sorted where they lie instead of
+// being copied into a separate array first. Header only, cpu_radix.cpp is built on its own.
+//
+
+#ifndef RADIXCOMPUTE_MAPPED_FILE_H
+#define RADIXCOMPUTE_MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile {
+public:
+  // Maps the file read-write. On POSIX the mapping length is rounded up to alignment, e.g. for
+  // VK_EXT_external_memory_host, the bytes past the end of the file must never be touched.
+  // Windows cannot map past the end of a file and maps the exact size.
+  explicit MappedFile(const std::string &path, size_t alignment = 1) {
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER fileSize;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)) {
+      fail(path);
+    }
+    length = fileSize.QuadPart;
+    mappedLength = length;
+    if (length > 0) {
+      mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+      address = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : nullptr;
+      if (address == nullptr) {
+        fail(path);
+      }
+    }
+#else
+    descriptor = open(path.c_str(), O_RDWR);
+    struct stat fileStat;
+    if (descriptor < 0 || fstat(descriptor, &fileStat) != 0) {
+      fail(path);
+    }
+    length = fileStat.st_size;
+    mappedLength = (length + alignment - 1) / alignment * alignment;
+    if (length > 0) {
+      address = mmap(nullptr, mappedLength, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+      if (address == MAP_FAILED) {
+        fail(path);
+      }
+      // the sort reads everything once front to back
+      madvise(address, length, MADV_SEQUENTIAL);
+    }
+#endif
+  }
+
+  ~MappedFile() {
+#ifdef _WIN32
+    if (address != nullptr) {
+      UnmapViewOfFile(address);
+    }
+    if (mapping != nullptr) {
+      CloseHandle(mapping);
+    }
+    CloseHandle(file);
+#else
+    if (address != nullptr) {
+      munmap(address, mappedLength);
+    }
+    close(descriptor);
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // nullptr for an empty file
+  void *data() const {
+    return address;
+  }
+
+  // size of the file, not of the mapping
+  size_t size() const {
+    return length;
+  }
+
+private:
+  static void fail(const std::string &path) {
+    std::cout << "Failed to map " << path << std::endl;
+    exit(-1);
+  }
+
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#else
+  int descriptor = -1;
+#endif
+  void *address = nullptr;
+  size_t length = 0;
+  size_t mappedLength = 0;
+};
+
+#endif //RADIXCOMPUTE_MAPPED_FILE_H
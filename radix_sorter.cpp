@@ -0,0 +1,2213 @@
+#include "radix_sorter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <malloc.h>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <filesystem>
+#include <random>
+#include <sstream>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#ifdef RADIX_EMBED_SHADERS
+// generated from shaders/ by radix_shader() in CMakeLists.txt
+#include "radix_histogram.spv.h"
+#include "radix_histogram64.spv.h"
+#include "radix_scan.spv.h"
+#include "radix_globalsums.spv.h"
+#include "radix_reorder.spv.h"
+#include "radix_reorder_kv.spv.h"
+#include "radix_reorder64.spv.h"
+#include "radix_reorder64_kv.spv.h"
+#include "radix_onesweep_histogram.spv.h"
+#include "radix_onesweep_histogram64.spv.h"
+#include "radix_onesweep.spv.h"
+#include "radix_onesweep_kv.spv.h"
+#include "radix_onesweep64.spv.h"
+#include "radix_onesweep64_kv.spv.h"
+#include "radix_scan_subgroup.spv.h"
+#include "radix_reorder_subgroup.spv.h"
+#include "radix_reorder_subgroup_kv.spv.h"
+#include "radix_reorder64_subgroup.spv.h"
+#include "radix_reorder64_subgroup_kv.spv.h"
+#include "radix_onesweep_subgroup.spv.h"
+#include "radix_onesweep_subgroup_kv.spv.h"
+#include "radix_onesweep64_subgroup.spv.h"
+#include "radix_onesweep64_subgroup_kv.spv.h"
+#include "radix_histogram_segmented.spv.h"
+#include "radix_reorder_segmented.spv.h"
+#include "radix_reorder_segmented_kv.spv.h"
+#endif
+
+#define BAIL_ON_BAD_RESULT(result) \
+  if (VK_SUCCESS != (result)) { fprintf(stderr, "Failure at %u %s\n", __LINE__, __FILE__); exit(result); }
+
+#define MAX_WG_NUMBER 65535
+
+// sort buffers this many times larger than the current sort needs are reallocated smaller
+#define BUFFER_SHRINK_FACTOR 4
+
+// the look-back packs a status into the top two bits of every count
+#define ONESWEEP_MAX_LENGTH ((1u << 30) - 1)
+
+// segment pieces per work group of a segmented sort even if more fit, every key searches them for its own
+#define SEGMENT_MAX_PIECES 64
+
+// Must match shaders/radix_common.glsl
+#define FLAG_IDENTITY_VALUES 1
+#define FLAG_ENCODE_KEYS 2
+#define FLAG_DECODE_KEYS 4
+#define FLAG_KEY_SIGNED 8
+#define FLAG_KEY_FLOAT 16
+
+// Number of specialization constants, see the constant_id layouts in shaders/radix_common.glsl
+#define SPEC_COUNT 9
+
+typedef struct PushConsts {
+    uint32_t inputLength;
+    uint32_t sumArrLength;
+    uint32_t startBit;
+    uint32_t elementsPerWI;
+    uint32_t flags;
+    // smallest encoded key of a narrowed key range, see encodeKey in shaders/radix_common.glsl
+    uint32_t keyBiasLow;
+    uint32_t keyBiasHigh;
+} PushConsts;
+
+static bool readShaderFile(const std::string &filename, std::vector<char> &fileContent) {
+  std::ifstream shaderFile(filename, std::ios::ate | std::ios::binary);
+
+  if (!shaderFile.is_open()) {
+    std::cerr << "Failed to open shader file " << filename << std::endl;
+    return false;
+  }
+  size_t fileSize = static_cast<size_t>(shaderFile.tellg());
+  fileContent.resize(fileSize);
+  shaderFile.seekg(0);
+  shaderFile.read(fileContent.data(), fileSize);
+  shaderFile.close();
+
+  return true;
+}
+
+// SPIR-V compiled into the binary, in the shader order of RadixSorter. Empty if nothing was embedded.
+// With subgroup set the -DSUBGROUP variants take the place of radix_scan, radix_reorder and radix_onesweep.
+static std::span<const uint32_t> embeddedShader(uint32_t index, bool subgroup) {
+#ifdef RADIX_EMBED_SHADERS
+  static const std::span<const uint32_t> shaders[] = {
+      radix_histogram_spv, radix_histogram64_spv, radix_scan_spv, radix_globalsums_spv,
+      radix_reorder_spv, radix_reorder_kv_spv, radix_reorder64_spv, radix_reorder64_kv_spv,
+      radix_onesweep_histogram_spv, radix_onesweep_histogram64_spv,
+      radix_onesweep_spv, radix_onesweep_kv_spv, radix_onesweep64_spv, radix_onesweep64_kv_spv,
+      radix_histogram_segmented_spv, radix_reorder_segmented_spv, radix_reorder_segmented_kv_spv
+  };
+  static const std::span<const uint32_t> subgroupShaders[] = {
+      {}, {}, radix_scan_subgroup_spv, {},
+      radix_reorder_subgroup_spv, radix_reorder_subgroup_kv_spv, radix_reorder64_subgroup_spv, radix_reorder64_subgroup_kv_spv,
+      {}, {}, radix_onesweep_subgroup_spv, radix_onesweep_subgroup_kv_spv, radix_onesweep64_subgroup_spv, radix_onesweep64_subgroup_kv_spv,
+      {}, {}, {}
+  };
+  return subgroup && !subgroupShaders[index].empty() ? subgroupShaders[index] : shaders[index];
+#else
+  return {};
+#endif
+}
+
+// Reads a pipeline cache saved by an earlier run. Caches of another device or driver version
+// are dropped here, drivers are not required to reject them on their own.
+static void loadPipelineCache(const std::string &filename, const VkPhysicalDeviceProperties &properties,
+                              std::vector<char> &cacheData) {
+  std::ifstream cacheFile(filename, std::ios::ate | std::ios::binary);
+  if (!cacheFile.is_open()) { // first run
+    return;
+  }
+  cacheData.resize(static_cast<size_t>(cacheFile.tellg()));
+  cacheFile.seekg(0);
+  cacheFile.read(cacheData.data(), cacheData.size());
+
+  VkPipelineCacheHeaderVersionOne header;
+  if (!cacheFile || cacheData.size() < sizeof(header)) {
+    cacheData.clear();
+    return;
+  }
+  memcpy(&header, cacheData.data(), sizeof(header));
+  if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+      memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    cacheData.clear();
+  }
+}
+
+// Writes a temporary file and renames it, so processes starting concurrently never read half a cache.
+// The process id keeps the temporary names of concurrent processes apart, the random part those of
+// sorters within one process.
+static void savePipelineCache(const std::string &filename, const std::vector<char> &cacheData) {
+  const std::string tmpFilename = filename + "." + std::to_string(getpid()) + "." + std::to_string(std::random_device()());
+  {
+    std::ofstream cacheFile(tmpFilename, std::ios::binary | std::ios::trunc);
+    cacheFile.write(cacheData.data(), cacheData.size());
+    if (!cacheFile) {
+      std::cerr << "Failed to write pipeline cache " << tmpFilename << std::endl;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tmpFilename, filename, error);
+  if (error) {
+    std::filesystem::remove(tmpFilename, error);
+  }
+}
+
+// Sorts small inputs on the host. Ties are broken by the original index, so the order of the
+// values matches the stable device sort.
+template<typename U>
+static void hostSort(U *keys, size_t length, RadixKeyType keyType, uint32_t *values, bool identityValues) {
+  std::vector<std::pair<U, uint32_t>> entries(length);
+  for (size_t i = 0; i < length; i++) {
+    entries[i] = {encodeKeyBits(keys[i], keyType), (uint32_t) i};
+  }
+  std::sort(entries.begin(), entries.end());
+
+  const std::vector<U> unsortedKeys(keys, keys + length);
+  std::vector<uint32_t> unsortedValues;
+  if (values != nullptr && !identityValues) {
+    unsortedValues.assign(values, values + length);
+  }
+  for (size_t i = 0; i < length; i++) {
+    const uint32_t source = entries[i].second;
+    keys[i] = unsortedKeys[source];
+    if (values != nullptr) {
+      values[i] = identityValues ? source : unsortedValues[source];
+    }
+  }
+}
+
+static bool isKey64(RadixKeyType keyType) {
+  return keyType == RadixKeyType::UINT64 || keyType == RadixKeyType::INT64 || keyType == RadixKeyType::DOUBLE;
+}
+
+static uint32_t keyTypeFlags(RadixKeyType keyType) {
+  switch (keyType) {
+    case RadixKeyType::INT32:
+    case RadixKeyType::INT64:
+      return FLAG_KEY_SIGNED;
+    case RadixKeyType::FLOAT:
+    case RadixKeyType::DOUBLE:
+      return FLAG_KEY_FLOAT;
+    default:
+      return 0;
+  }
+}
+
+// Copies the keys and widens [low, high] to the smallest and largest encoded key. Sorted minus low,
+// every key fits into the bits of high - low, so the digits above need no pass. Called once per
+// chunk when the keys are staged.
+template<typename U>
+static void uploadKeys(const U *src, U *dst, size_t length, RadixKeyType keyType, uint64_t &low, uint64_t &high) {
+  U chunkLow = std::numeric_limits<U>::max();
+  U chunkHigh = 0;
+  for (size_t i = 0; i < length; i++) {
+    U key = src[i];
+    dst[i] = key;
+    key = encodeKeyBits(key, keyType);
+    chunkLow = std::min(chunkLow, key);
+    chunkHigh = std::max(chunkHigh, key);
+  }
+  low = std::min<uint64_t>(low, chunkLow);
+  high = std::max<uint64_t>(high, chunkHigh);
+}
+
+VkResult vkGetBestTransferQueueNPH(VkPhysicalDevice physicalDevice, uint32_t *queueFamilyIndex) {
+  uint32_t queueFamilyPropertiesCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, 0);
+
+  VkQueueFamilyProperties *const queueFamilyProperties = (VkQueueFamilyProperties *) _malloca(
+      sizeof(VkQueueFamilyProperties) * queueFamilyPropertiesCount);
+
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, queueFamilyProperties);
+
+  // first try and find a queue that has just the transfer bit set
+  for (uint32_t i = 0; i < queueFamilyPropertiesCount; i++) {
+    // mask out the sparse binding bit that we aren't caring about (yet!)
+    const VkQueueFlags maskedFlags = (~VK_QUEUE_SPARSE_BINDING_BIT & queueFamilyProperties[i].queueFlags);
+
+    if (!((VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT) & maskedFlags) &&
+        (VK_QUEUE_TRANSFER_BIT & maskedFlags)) {
+      *queueFamilyIndex = i;
+      return VK_SUCCESS;
+    }
+  }
+
+  // otherwise we'll prefer using a compute-only queue,
+  // remember that having compute on the queue implicitly enables transfer!
+  for (uint32_t i = 0; i < queueFamilyPropertiesCount; i++) {
+    // mask out the sparse binding bit that we aren't caring about (yet!)
+    const VkQueueFlags maskedFlags = (~VK_QUEUE_SPARSE_BINDING_BIT & queueFamilyProperties[i].queueFlags);
+
+    if (!(VK_QUEUE_GRAPHICS_BIT & maskedFlags) && (VK_QUEUE_COMPUTE_BIT & maskedFlags)) {
+      *queueFamilyIndex = i;
+      return VK_SUCCESS;
+    }
+  }
+
+  // lastly get any queue that'll work for us (graphics, compute or transfer bit set)
+  for (uint32_t i = 0; i < queueFamilyPropertiesCount; i++) {
+    // mask out the sparse binding bit that we aren't caring about (yet!)
+    const VkQueueFlags maskedFlags = (~VK_QUEUE_SPARSE_BINDING_BIT & queueFamilyProperties[i].queueFlags);
+
+    if ((VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT) & maskedFlags) {
+      *queueFamilyIndex = i;
+      return VK_SUCCESS;
+    }
+  }
+
+  return VK_ERROR_INITIALIZATION_FAILED;
+}
+
+VkResult vkGetBestComputeQueueNPH(VkPhysicalDevice physicalDevice, uint32_t *queueFamilyIndex) {
+  uint32_t queueFamilyPropertiesCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, 0);
+
+  VkQueueFamilyProperties *const queueFamilyProperties = (VkQueueFamilyProperties *) _malloca(
+      sizeof(VkQueueFamilyProperties) * queueFamilyPropertiesCount);
+
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, queueFamilyProperties);
+
+  // first try and find a queue that has just the compute bit set
+  for (uint32_t i = 0; i < queueFamilyPropertiesCount; i++) {
+    // mask out the sparse binding bit that we aren't caring about (yet!) and the transfer bit
+    const VkQueueFlags maskedFlags = (~(VK_QUEUE_TRANSFER_BIT | VK_QUEUE_SPARSE_BINDING_BIT) &
+                                      queueFamilyProperties[i].queueFlags);
+
+    if (!(VK_QUEUE_GRAPHICS_BIT & maskedFlags) && (VK_QUEUE_COMPUTE_BIT & maskedFlags)) {
+      *queueFamilyIndex = i;
+      return VK_SUCCESS;
+    }
+  }
+
+  // lastly get any queue that'll work for us
+  for (uint32_t i = 0; i < queueFamilyPropertiesCount; i++) {
+    // mask out the sparse binding bit that we aren't caring about (yet!) and the transfer bit
+    const VkQueueFlags maskedFlags = (~(VK_QUEUE_TRANSFER_BIT | VK_QUEUE_SPARSE_BINDING_BIT) &
+                                      queueFamilyProperties[i].queueFlags);
+
+    if (VK_QUEUE_COMPUTE_BIT & maskedFlags) {
+      *queueFamilyIndex = i;
+      return VK_SUCCESS;
+    }
+  }
+
+  return VK_ERROR_INITIALIZATION_FAILED;
+}
+
+const std::vector<const char *> validationLayers = {
+    "VK_LAYER_KHRONOS_validation"
+};
+
+bool checkValidationLayerSupport() {
+  uint32_t layerCount;
+  vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+  std::vector<VkLayerProperties> availableLayers(layerCount);
+  vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+  for (const char *layerName: validationLayers) {
+    bool layerFound = false;
+
+    for (const auto &layerProperties: availableLayers) {
+      if (strcmp(layerName, layerProperties.layerName) == 0) {
+        layerFound = true;
+        break;
+      }
+    }
+
+    if (!layerFound) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
+    VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+    VkDebugUtilsMessageTypeFlagsEXT messageType,
+    const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+    void *pUserData) {
+
+  std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+
+  return VK_FALSE;
+}
+
+VkResult
+CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo, const VkAllocationCallbacks *pAllocator,
+                             VkDebugUtilsMessengerEXT *pDebugMessenger) {
+  auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+  if (func != nullptr) {
+    return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+  }
+  else {
+    return VK_ERROR_EXTENSION_NOT_PRESENT;
+  }
+}
+
+RadixSorter::RadixSorter(const RadixSorterConfig &config) :
+    engine(config.engine), narrowKeyRange(config.narrowKeyRange), hostSortThreshold(config.hostSortThreshold), radixBits(config.radixBits),
+    groupSize(config.groupSize), scanBlockSize(config.groupSize * config.scanElementsPerWI),
+    globalSumsElementsPerWI(config.globalSumsElementsPerWI), onesweepGroupSize(config.onesweepGroupSize),
+    onesweepTileSize(config.onesweepGroupSize * config.onesweepKeysPerThread),
+    stageTimestamps(config.stageTimestamps), deviceLocal(config.deviceLocalBuffers), stagingChunkSize(config.stagingChunkSize / sizeof(uint64_t) * sizeof(uint64_t)) {
+  // the histogram scan takes any number of work groups, only the dispatch limit remains
+  maxWgCount = MAX_WG_NUMBER;
+  if (config.asyncJobs == 0) {
+    std::cout << "Invalid RadixSorterConfig: asyncJobs must be at least 1" << std::endl;
+    exit(-1);
+  }
+  jobs.resize(config.asyncJobs);
+  createInstance(config);
+  createDevice(config);
+  checkConfig(config);
+  createPipelines(config);
+  createDescriptorSets();
+  createCommandBuffer();
+}
+
+RadixSorter::~RadixSorter() {
+  // sorts still in flight deliver their results before the buffers go away
+  for (SortJob &pending : jobs) {
+    if (pending.ticket != 0) {
+      finishJob(pending);
+    }
+  }
+  vkDeviceWaitIdle(device);
+
+  for (SortJob &sortJob : jobs) {
+    destroyBuffer(sortJob.inputBuffer);
+    destroyBuffer(sortJob.outputBuffer);
+    destroyBuffer(sortJob.valueInputBuffer);
+    destroyBuffer(sortJob.valueOutputBuffer);
+    destroyBuffer(sortJob.histogramBuffer);
+    for (Buffer &buffer : sortJob.scanTotalBuffers) {
+      destroyBuffer(buffer);
+    }
+    destroyBuffer(sortJob.digitHistogramBuffer);
+    destroyBuffer(sortJob.partitionStateBuffer);
+    destroyBuffer(sortJob.segmentPieceBuffer);
+    destroyBuffer(sortJob.segmentGroupBuffer);
+    vkDestroyQueryPool(device, sortJob.timestampPool, 0);
+    vkDestroyFence(device, sortJob.fence, 0);
+  }
+  destroyBuffer(stagingBuffer);
+  for (MemoryPool &pool : memoryPools) {
+    for (MemoryBlock &block : pool.blocks) {
+      if (block.mapped != nullptr) {
+        vkUnmapMemory(device, block.memory);
+      }
+      vkFreeMemory(device, block.memory, 0);
+    }
+  }
+
+  vkDestroySemaphore(device, timeline, 0);
+  vkDestroyCommandPool(device, transferCommandPool, 0);
+  vkDestroyCommandPool(device, commandPool, 0);
+  vkDestroyDescriptorPool(device, descriptorPool, 0);
+  for (uint32_t i = 0; i < SHADER_COUNT; i++) {
+    vkDestroyPipeline(device, pipelines[i], 0);
+    vkDestroyShaderModule(device, shaderModules[i], 0);
+  }
+  vkDestroyPipelineLayout(device, histogramPipelineLayout, 0);
+  vkDestroyPipelineLayout(device, scanPipelineLayout, 0);
+  vkDestroyPipelineLayout(device, reorderPipelineLayout, 0);
+  vkDestroyDescriptorSetLayout(device, histogramDescSetLayout, 0);
+  vkDestroyDescriptorSetLayout(device, scanDescSetLayout, 0);
+  vkDestroyDescriptorSetLayout(device, reorderDescSetLayout, 0);
+  vkDestroyDevice(device, 0);
+  vkDestroyInstance(instance, 0);
+}
+
+void RadixSorter::createInstance(const RadixSorterConfig &config) {
+  // VK APP SETUP
+  const VkApplicationInfo applicationInfo = {
+      VK_STRUCTURE_TYPE_APPLICATION_INFO,
+      0,
+      "VKComputeSample",
+      0,
+      "",
+      0,
+      VK_MAKE_VERSION(1, 2, 0)
+  };
+
+  if (config.validation && !checkValidationLayerSupport()) {
+    std::cerr << "No validation layer support" << std::endl;
+    exit(-1);
+  }
+
+  const char *validationFeatures[] = {"VK_EXT_validation_features", "VK_EXT_debug_utils"};
+
+  const VkInstanceCreateInfo instanceCreateInfo = {
+      VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO, 0, 0, &applicationInfo,
+      config.validation ? static_cast<uint32_t>(validationLayers.size()) : 0, validationLayers.data(),
+      config.validation ? 2u : 0u, validationFeatures
+  };
+
+  BAIL_ON_BAD_RESULT(vkCreateInstance(&instanceCreateInfo, 0, &instance));
+  // VK APP SETUP - END
+}
+
+void RadixSorter::createDevice(const RadixSorterConfig &config) {
+  // SETUP PHYSICAL DEVICES
+  uint32_t physicalDeviceCount = 0;
+  BAIL_ON_BAD_RESULT(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, 0));
+
+  std::vector<VkPhysicalDevice> physicalDevices(physicalDeviceCount);
+  BAIL_ON_BAD_RESULT(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices.data()));
+
+  if (physicalDeviceCount == 0) {
+    std::cout << "No physical devices that support Vulkan applications" << std::endl;
+    exit(-1);
+  }
+  if (config.deviceIndex >= physicalDeviceCount) {
+    std::cout << "Device index " << config.deviceIndex << " is out of range, " << physicalDeviceCount << " devices present" << std::endl;
+    exit(-1);
+  }
+  physicalDevice = physicalDevices[config.deviceIndex];
+  // SETUP PHYSICAL DEVICES - END
+
+  // CREATE VkDevice
+  BAIL_ON_BAD_RESULT(vkGetBestComputeQueueNPH(physicalDevice, &queueFamilyIndex));
+  transferFamilyIndex = queueFamilyIndex;
+  if (deviceLocal) {
+    BAIL_ON_BAD_RESULT(vkGetBestTransferQueueNPH(physicalDevice, &transferFamilyIndex));
+  }
+
+  const float queuePrioritory = 1.0f;
+  const VkDeviceQueueCreateInfo deviceQueueCreateInfos[2] = {
+      {
+          VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+          0,
+          0,
+          queueFamilyIndex,
+          1,
+          &queuePrioritory
+      },
+      {
+          VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+          0,
+          0,
+          transferFamilyIndex,
+          1,
+          &queuePrioritory
+      }
+  };
+
+  // the staging ring synchronizes the transfer and compute queues with a timeline semaphore
+  VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+  vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  vulkan12Features.timelineSemaphore = VK_TRUE;
+
+  // sortInPlace imports host memory as buffers when the device can, device local buffers never alias host memory
+  bool hostImport = false;
+  if (!deviceLocal) {
+    uint32_t extensionCount = 0;
+    BAIL_ON_BAD_RESULT(vkEnumerateDeviceExtensionProperties(physicalDevice, 0, &extensionCount, 0));
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    BAIL_ON_BAD_RESULT(vkEnumerateDeviceExtensionProperties(physicalDevice, 0, &extensionCount, extensions.data()));
+    for (const VkExtensionProperties &extension : extensions) {
+      if (strcmp(extension.extensionName, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0) {
+        hostImport = true;
+      }
+    }
+  }
+  const char *deviceExtensions[] = {VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME};
+
+  const VkDeviceCreateInfo deviceCreateInfo = {
+      VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      deviceLocal ? &vulkan12Features : 0,
+      0,
+      transferFamilyIndex != queueFamilyIndex ? 2u : 1u,
+      deviceQueueCreateInfos,
+      0,
+      0,
+      hostImport ? 1u : 0u,
+      deviceExtensions,
+      0
+  };
+
+  BAIL_ON_BAD_RESULT(vkCreateDevice(physicalDevice, &deviceCreateInfo, 0, &device));
+  vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
+  vkGetDeviceQueue(device, transferFamilyIndex, 0, &transferQueue);
+  // CREATE VkDevice - END
+
+  if (hostImport) {
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties = {};
+    hostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &hostProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+    getMemoryHostPointerProperties = (PFN_vkGetMemoryHostPointerPropertiesEXT) vkGetDeviceProcAddr(device, "vkGetMemoryHostPointerPropertiesEXT");
+    if (getMemoryHostPointerProperties != nullptr) {
+      importAlignment = hostProperties.minImportedHostPointerAlignment;
+    }
+  }
+
+  // the pools stay empty until a buffer picks their type, see findMemoryType
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+  for (uint32_t k = 0; k < memoryProperties.memoryTypeCount; k++) {
+    memoryPools[k].typeIndex = k;
+    memoryPools[k].hostVisible = (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT & memoryProperties.memoryTypes[k].propertyFlags) != 0;
+    memoryPools[k].firstBlockSize = config.memoryBlockSize;
+    memoryPools[k].nextBlockSize = config.memoryBlockSize;
+  }
+}
+
+static bool isPowerOfTwo(uint32_t value) {
+  return value != 0 && (value & (value - 1)) == 0;
+}
+
+void RadixSorter::checkConfig(const RadixSorterConfig &config) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  const VkPhysicalDeviceLimits &limits = properties.limits;
+  const uint32_t radixElements = 1u << config.radixBits;
+  // only the pipelines of the configured engine are created, the other group size is never used
+  const uint32_t engineGroupSize = engine == RadixEngine::ONESWEEP ? config.onesweepGroupSize : config.groupSize;
+
+  const char *error = nullptr;
+  if (config.radixBits == 0 || config.radixBits > 16) {
+    error = "radixBits must be between 1 and 16";
+  }
+  else if (!isPowerOfTwo(engineGroupSize)) {
+    error = "The group size of the engine must be a power of two";
+  }
+  else if (engineGroupSize > limits.maxComputeWorkGroupInvocations || engineGroupSize > limits.maxComputeWorkGroupSize[0]) {
+    error = "The group size of the engine exceeds the work group limits of the device";
+  }
+  else if (radixElements > engineGroupSize) {
+    error = "Every digit needs a thread, 2^radixBits may not exceed the group size of the engine";
+  }
+  else if (config.sortRadixBits == 0 || config.radixBits % config.sortRadixBits != 0) {
+    error = "sortRadixBits must divide radixBits";
+  }
+  else if (config.scanElementsPerWI == 0 || config.globalSumsElementsPerWI == 0 || config.onesweepKeysPerThread == 0) {
+    error = "The elements per work item must be positive";
+  }
+  else if (engine == RadixEngine::MULTI_PASS && pow((double) config.groupSize * config.scanElementsPerWI, MAX_SCAN_LEVELS) < pow(2.0, 32)) {
+    error = "groupSize * scanElementsPerWI is too small to scan 2^32 buckets in four levels";
+  }
+  else if (config.deviceLocalBuffers && stagingChunkSize == 0) {
+    error = "stagingChunkSize must hold at least one 64 bit key";
+  }
+  if (error != nullptr) {
+    std::cout << "Invalid RadixSorterConfig: " << error << std::endl;
+    exit(-1);
+  }
+
+  // SUBGROUP SUPPORT
+  // The subgroup shaders need ballots in compute shaders and whole subgroups in every work group.
+  // radix_scan also adds over subgroups and keeps the subgroup totals of a work group in a single
+  // subgroup, radix_reorder keeps a digit count per subgroup in shared memory. Only the pipelines of
+  // the configured engine are created, so only its shaders count. Otherwise subgroupSize stays 0
+  // and the shared memory shaders run.
+  if (config.subgroupRanking) {
+    VkPhysicalDeviceSubgroupProperties subgroupProperties = {};
+    subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &subgroupProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+    const bool onesweep = engine == RadixEngine::ONESWEEP;
+    const VkSubgroupFeatureFlags requiredOperations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT |
+        (onesweep ? 0 : VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
+    const uint32_t size = subgroupProperties.subgroupSize;
+    const bool supported = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+        (subgroupProperties.supportedOperations & requiredOperations) == requiredOperations;
+    const bool fits = onesweep ? config.onesweepGroupSize % size == 0 :
+        config.groupSize % size == 0 && config.groupSize / size <= size &&
+        sizeof(uint32_t) * ((uint64_t) config.groupSize / size + 1) * radixElements <= limits.maxComputeSharedMemorySize;
+    if (supported && isPowerOfTwo(size) && fits) {
+      subgroupSize = size;
+    }
+  }
+  // SUBGROUP SUPPORT - END
+
+  // ONESWEEP SHARED MEMORY
+  // tile keys of the widest type, tile values, the digit counts, two digit arrays and the tile index
+  // of radix_onesweep.comp. The subgroup build counts every digit per subgroup and in the tile, the
+  // shared memory build per thread plus the thread scan totals.
+  if (engine == RadixEngine::ONESWEEP) {
+    const uint64_t countWords = subgroupSize != 0 ?
+        (uint64_t) onesweepGroupSize / subgroupSize * radixElements + radixElements :
+        (uint64_t) radixElements * onesweepGroupSize + onesweepGroupSize;
+    const uint64_t onesweepSharedSize = (uint64_t) onesweepTileSize * (sizeof(uint64_t) + sizeof(uint32_t)) +
+        sizeof(uint32_t) * (countWords + 2 * radixElements + 1);
+    if (onesweepSharedSize > limits.maxComputeSharedMemorySize) {
+      std::cout << "Invalid RadixSorterConfig: A onesweep tile does not fit into the shared memory of the device" << std::endl;
+      exit(-1);
+    }
+  }
+  // ONESWEEP SHARED MEMORY - END
+
+  // SEGMENTED SHARED MEMORY
+  // radix_reorder.comp -DSEGMENTED keeps the block sort of the shared memory build and adds a carry
+  // and a run start per piece and digit plus the piece starts. A work group takes as many pieces as
+  // fit next to the block sort, segmented sorts are refused if not even one does.
+  if (engine == RadixEngine::MULTI_PASS) {
+    const uint64_t blockSize = 2 * (uint64_t) config.groupSize >> config.sortRadixBits;
+    const uint64_t blockWords = ((uint64_t) 3 << config.sortRadixBits) * blockSize + 3 * blockSize + 3 * radixElements + 2;
+    const uint64_t pieceWords = 2 * (uint64_t) radixElements + 1;
+    const uint64_t sharedWords = limits.maxComputeSharedMemorySize / sizeof(uint32_t);
+    maxSegmentPieces = sharedWords > blockWords ?
+        (uint32_t) std::min<uint64_t>((sharedWords - blockWords) / pieceWords, SEGMENT_MAX_PIECES) : 0;
+  }
+  // SEGMENTED SHARED MEMORY - END
+}
+
+void RadixSorter::createPipelines(const RadixSorterConfig &config) {
+  // CREATE SHADER MODULES
+  const char *shaderFiles[SHADER_COUNT] = {
+      "radix_histogram.spv", "radix_histogram64.spv", "radix_scan.spv", "radix_globalsums.spv",
+      "radix_reorder.spv", "radix_reorder_kv.spv", "radix_reorder64.spv", "radix_reorder64_kv.spv",
+      "radix_onesweep_histogram.spv", "radix_onesweep_histogram64.spv",
+      "radix_onesweep.spv", "radix_onesweep_kv.spv", "radix_onesweep64.spv", "radix_onesweep64_kv.spv",
+      "radix_histogram_segmented.spv", "radix_reorder_segmented.spv", "radix_reorder_segmented_kv.spv"
+  };
+  // the -DSUBGROUP variants of radix_scan, radix_reorder and radix_onesweep, used if checkConfig
+  // found subgroup support
+  if (subgroupSize != 0) {
+    shaderFiles[2] = "radix_scan_subgroup.spv";
+    shaderFiles[4] = "radix_reorder_subgroup.spv";
+    shaderFiles[5] = "radix_reorder_subgroup_kv.spv";
+    shaderFiles[6] = "radix_reorder64_subgroup.spv";
+    shaderFiles[7] = "radix_reorder64_subgroup_kv.spv";
+    shaderFiles[10] = "radix_onesweep_subgroup.spv";
+    shaderFiles[11] = "radix_onesweep_subgroup_kv.spv";
+    shaderFiles[12] = "radix_onesweep64_subgroup.spv";
+    shaderFiles[13] = "radix_onesweep64_subgroup_kv.spv";
+  }
+  // only the shaders of the configured engine are loaded, the other engine's may not even fit the
+  // device. The same goes for the segmented ones without room for a segment piece.
+  std::vector<uint32_t> engineShaders;
+  for (uint32_t i = 0; i < SHADER_COUNT; i++) {
+    const bool onesweepShader = i >= ONESWEEP_FIRST_SHADER && i < SEGMENTED_FIRST_SHADER;
+    const bool segmentedShader = i >= SEGMENTED_FIRST_SHADER;
+    if (engine == RadixEngine::ONESWEEP ? onesweepShader : !onesweepShader && (!segmentedShader || maxSegmentPieces != 0)) {
+      engineShaders.push_back(i);
+    }
+  }
+
+  std::vector<char> computeShader{};
+  for (uint32_t i : engineShaders) {
+    std::span<const uint32_t> code = embeddedShader(i, subgroupSize != 0);
+    if (!config.shaderDir.empty()) {
+      if (!readShaderFile(config.shaderDir + shaderFiles[i], computeShader)) {
+        exit(-1);
+      }
+      code = {reinterpret_cast<const uint32_t *>(computeShader.data()), computeShader.size() / sizeof(uint32_t)};
+    }
+    else if (code.empty()) {
+      std::cerr << "No shaders were embedded at build time, RadixSorterConfig::shaderDir must be set" << std::endl;
+      exit(-1);
+    }
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {
+        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        0,
+        0,
+        code.size_bytes(),
+        code.data()
+    };
+    BAIL_ON_BAD_RESULT(vkCreateShaderModule(device, &shaderModuleCreateInfo, 0, &shaderModules[i]));
+  }
+  // CREATE SHADER MODULES - END
+
+  // DESCRIPTOR SET LAYOUTS AND BINDINGS
+  // bindings 2 and 3 are the segment pieces and the first piece of every work group, only used by
+  // radix_histogram_segmented
+  VkDescriptorSetLayoutBinding histogramDescSetLayoutBindings[4] = {
+      {
+          0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      }
+  };
+  VkDescriptorSetLayoutCreateInfo histogramDescSetLayoutCreateInfo = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, 0, 0, 4, histogramDescSetLayoutBindings
+  };
+  BAIL_ON_BAD_RESULT(vkCreateDescriptorSetLayout(device, &histogramDescSetLayoutCreateInfo, 0, &histogramDescSetLayout));
+
+  VkDescriptorSetLayoutBinding scanDescSetLayoutBindings[2] = {
+      {
+          0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      }
+  };
+  VkDescriptorSetLayoutCreateInfo scanDescSetLayoutCreateInfo = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, 0, 0, 2, scanDescSetLayoutBindings
+  };
+  BAIL_ON_BAD_RESULT(vkCreateDescriptorSetLayout(device, &scanDescSetLayoutCreateInfo, 0, &scanDescSetLayout));
+
+  // bindings 4 and 5 are the input and output value buffers, only used by the _kv variants.
+  // The keys only variants share the layout and simply never touch them. Bindings 6 and 7 are
+  // the segment buffers of the histogram layout for the _segmented variants.
+  VkDescriptorSetLayoutBinding reorderDescSetLayoutBindings[8] = {
+      {
+          0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      },
+      {
+          7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0
+      }
+  };
+  VkDescriptorSetLayoutCreateInfo reorderDescSetLayoutCreateInfo = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, 0, 0, 8, reorderDescSetLayoutBindings
+  };
+  BAIL_ON_BAD_RESULT(vkCreateDescriptorSetLayout(device, &reorderDescSetLayoutCreateInfo, 0, &reorderDescSetLayout));
+  // DESCRIPTOR SET LAYOUTS AND BINDINGS - END
+
+  // PIPELINE LAYOUTS CREATION
+  VkPushConstantRange pushConstantRange = {
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      0,
+      sizeof(PushConsts)
+  };
+
+  VkPipelineLayoutCreateInfo histogramPipelineLayoutCreationInfo = {
+      VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, 0, 0, 1, &histogramDescSetLayout, 1, &pushConstantRange
+  };
+  BAIL_ON_BAD_RESULT(vkCreatePipelineLayout(device, &histogramPipelineLayoutCreationInfo, 0, &histogramPipelineLayout));
+
+  VkPipelineLayoutCreateInfo scanPipelineLayoutCreationInfo = {
+      VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, 0, 0, 1, &scanDescSetLayout, 1, &pushConstantRange
+  };
+  BAIL_ON_BAD_RESULT(vkCreatePipelineLayout(device, &scanPipelineLayoutCreationInfo, 0, &scanPipelineLayout));
+
+  VkPipelineLayoutCreateInfo reorderPipelineLayoutCreationInfo = {
+      VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, 0, 0, 1, &reorderDescSetLayout, 1, &pushConstantRange
+  };
+  BAIL_ON_BAD_RESULT(vkCreatePipelineLayout(device, &reorderPipelineLayoutCreationInfo, 0, &reorderPipelineLayout));
+  // PIPELINE LAYOUTS CREATION - END
+
+  // PIPELINE CACHE
+  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+  std::vector<char> cacheData{};
+  if (!config.pipelineCachePath.empty()) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    loadPipelineCache(config.pipelineCachePath, properties, cacheData);
+    const VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {
+        VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, 0, 0, cacheData.size(), cacheData.data()
+    };
+    BAIL_ON_BAD_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, 0, &pipelineCache));
+  }
+  // PIPELINE CACHE - END
+
+  // PIPELINES CREATION
+  const VkPipelineLayout pipelineLayouts[SHADER_COUNT] = {
+      histogramPipelineLayout, histogramPipelineLayout, scanPipelineLayout, scanPipelineLayout,
+      reorderPipelineLayout, reorderPipelineLayout, reorderPipelineLayout, reorderPipelineLayout,
+      histogramPipelineLayout, histogramPipelineLayout,
+      reorderPipelineLayout, reorderPipelineLayout, reorderPipelineLayout, reorderPipelineLayout,
+      histogramPipelineLayout, reorderPipelineLayout, reorderPipelineLayout
+  };
+  // every shader gets the same constants in constant_id order, each one only reads the ids it declares
+  const uint32_t specData[SPEC_COUNT] = {
+      config.radixBits, config.groupSize, config.scanElementsPerWI, config.sortRadixBits,
+      config.globalSumsElementsPerWI, config.onesweepGroupSize, config.onesweepKeysPerThread, std::max(subgroupSize, 1u),
+      std::max(maxSegmentPieces, 1u)
+  };
+  VkSpecializationMapEntry specEntries[SPEC_COUNT];
+  for (uint32_t i = 0; i < SPEC_COUNT; i++) {
+    specEntries[i] = {i, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t)};
+  }
+  const VkSpecializationInfo specInfo = {
+      SPEC_COUNT, specEntries, sizeof(specData), specData
+  };
+
+  // the histograms also count ranges of work groups while the keys upload, see submitUploadHistogram
+  const bool histogram[SHADER_COUNT] = {true, true, false, false, false, false, false, false, true, true};
+  std::vector<VkComputePipelineCreateInfo> pipelineInfos;
+  for (uint32_t i : engineShaders) {
+    pipelineInfos.push_back({
+        VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, 0, histogram[i] ? (VkPipelineCreateFlags) VK_PIPELINE_CREATE_DISPATCH_BASE_BIT : 0,
+        {
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, 0, 0, VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[i], "main", &specInfo
+        },
+        pipelineLayouts[i], 0, 0
+    });
+  }
+  std::vector<VkPipeline> enginePipelines(engineShaders.size());
+  BAIL_ON_BAD_RESULT(vkCreateComputePipelines(device, pipelineCache, pipelineInfos.size(), pipelineInfos.data(), 0,
+                                              enginePipelines.data()));
+  for (size_t i = 0; i < engineShaders.size(); i++) {
+    pipelines[engineShaders[i]] = enginePipelines[i];
+  }
+  // PIPELINES CREATION - END
+
+  // SAVE PIPELINE CACHE
+  if (pipelineCache != VK_NULL_HANDLE) {
+    size_t cacheSize = 0;
+    BAIL_ON_BAD_RESULT(vkGetPipelineCacheData(device, pipelineCache, &cacheSize, 0));
+    // an unchanged size means every pipeline came from the loaded cache
+    if (cacheSize != cacheData.size()) {
+      cacheData.resize(cacheSize);
+      BAIL_ON_BAD_RESULT(vkGetPipelineCacheData(device, pipelineCache, &cacheSize, cacheData.data()));
+      cacheData.resize(cacheSize);
+      savePipelineCache(config.pipelineCachePath, cacheData);
+    }
+    vkDestroyPipelineCache(device, pipelineCache, 0);
+  }
+  // SAVE PIPELINE CACHE - END
+}
+
+void RadixSorter::createDescriptorSets() {
+  // every job slot gets its own sets, they point at the buffers of that slot
+  const uint32_t jobCount = jobs.size();
+  VkDescriptorPoolSize descriptorPoolSize = {
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, (44 + 2 * MAX_SCAN_LEVELS) * jobCount
+  };
+
+  VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, 0, 0, (7 + MAX_SCAN_LEVELS) * jobCount, 1, &descriptorPoolSize
+  };
+  BAIL_ON_BAD_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, 0, &descriptorPool));
+
+  for (SortJob &sortJob : jobs) {
+    VkDescriptorSetAllocateInfo descSetAllocateInfo = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, 0, descriptorPool, 1, &histogramDescSetLayout
+    };
+    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descSetAllocateInfo, &sortJob.histDescSets[0]));
+    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descSetAllocateInfo, &sortJob.histDescSets[1]));
+    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descSetAllocateInfo, &sortJob.onesweepHistDescSet));
+
+    descSetAllocateInfo.pSetLayouts = &scanDescSetLayout;
+    for (VkDescriptorSet &scanDescSet : sortJob.scanDescSets) {
+      BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descSetAllocateInfo, &scanDescSet));
+    }
+
+    descSetAllocateInfo.pSetLayouts = &reorderDescSetLayout;
+    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descSetAllocateInfo, &sortJob.reorderDescSets[0]));
+    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descSetAllocateInfo, &sortJob.reorderDescSets[1]));
+    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descSetAllocateInfo, &sortJob.onesweepDescSets[0]));
+    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descSetAllocateInfo, &sortJob.onesweepDescSets[1]));
+  }
+}
+
+void RadixSorter::createCommandBuffer() {
+  VkCommandPoolCreateInfo commandPoolCreateInfo = {
+      VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, 0, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, queueFamilyIndex
+  };
+  BAIL_ON_BAD_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, 0, &commandPool));
+
+  VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, 0, commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1
+  };
+  const VkFenceCreateInfo fenceCI = {
+      VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+      0,
+      0
+  };
+  for (SortJob &sortJob : jobs) {
+    BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &sortJob.commandBuffer));
+    BAIL_ON_BAD_RESULT(vkCreateFence(device, &fenceCI, nullptr, &sortJob.fence));
+  }
+
+  // STAGE TIMESTAMPS
+  if (stageTimestamps) {
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, 0);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+    const uint32_t validBits = families[queueFamilyIndex].timestampValidBits;
+    if (validBits == 0) {
+      std::cout << "Invalid RadixSorterConfig: the compute queue cannot write timestamps" << std::endl;
+      exit(-1);
+    }
+    timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    // the start, four stages for every multi pass digit of a 64 bit key and the copy, onesweep needs fewer
+    timestampCapacity = 2 + 4 * ((64 + radixBits - 1) / radixBits);
+    const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+        VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, 0, 0, VK_QUERY_TYPE_TIMESTAMP, timestampCapacity, 0
+    };
+    for (SortJob &sortJob : jobs) {
+      BAIL_ON_BAD_RESULT(vkCreateQueryPool(device, &queryPoolCreateInfo, 0, &sortJob.timestampPool));
+    }
+  }
+  // STAGE TIMESTAMPS - END
+
+  if (!deviceLocal) {
+    return;
+  }
+  // STAGING RING
+  commandPoolCreateInfo.queueFamilyIndex = transferFamilyIndex;
+  BAIL_ON_BAD_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, 0, &transferCommandPool));
+  commandBufferAllocateInfo.commandPool = transferCommandPool;
+  commandBufferAllocateInfo.commandBufferCount = STAGING_SLOTS;
+  BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, transferCommandBuffers));
+
+  const VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {
+      VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO, 0, VK_SEMAPHORE_TYPE_TIMELINE, 0
+  };
+  const VkSemaphoreCreateInfo semaphoreCreateInfo = {
+      VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, &semaphoreTypeCreateInfo, 0
+  };
+  BAIL_ON_BAD_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &timeline));
+
+  ensureBuffer(stagingBuffer, STAGING_SLOTS * stagingChunkSize, true);
+  // STAGING RING - END
+}
+
+// Grows the buffer to hold at least size bytes. Smaller requests reuse the existing allocation
+// unless it is more than BUFFER_SHRINK_FACTOR times too large, then the buffer shrinks so trimPool
+// can hand the memory back. Imported buffers are never replaced.
+void RadixSorter::ensureBuffer(Buffer &buffer, VkDeviceSize size, bool hostVisible) {
+  if (buffer.size >= size && (buffer.pool == nullptr || buffer.size / BUFFER_SHRINK_FACTOR <= size)) {
+    return;
+  }
+  destroyBuffer(buffer);
+
+  // device local buffers are written and read by both queues, concurrent sharing saves the
+  // ownership transfers. The staging ring is only ever touched by the transfer queue.
+  const uint32_t queueFamilyIndices[2] = {queueFamilyIndex, transferFamilyIndex};
+  const bool concurrent = !hostVisible && transferFamilyIndex != queueFamilyIndex;
+  VkBufferCreateInfo bufferCreateInfo = {
+      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      0,
+      0,
+      size,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+      concurrent ? 2u : 1u,
+      queueFamilyIndices
+  };
+  BAIL_ON_BAD_RESULT(vkCreateBuffer(device, &bufferCreateInfo, 0, &buffer.buffer));
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(device, buffer.buffer, &requirements);
+
+  const VkMemoryPropertyFlags flags = hostVisible ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT :
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  allocateFromPool(memoryPools[findMemoryType(requirements.memoryTypeBits, flags)], requirements, buffer);
+  BAIL_ON_BAD_RESULT(vkBindBufferMemory(device, buffer.buffer, buffer.memory, buffer.offset));
+  buffer.size = size;
+}
+
+// First memory type in typeBits with all of flags, the driver lists the faster types first.
+// Every buffer accepts at least one host coherent and one device local type.
+uint32_t RadixSorter::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags flags) const {
+  for (uint32_t k = 0; k < memoryProperties.memoryTypeCount; k++) {
+    if ((typeBits & (1u << k)) && (memoryProperties.memoryTypes[k].propertyFlags & flags) == flags) {
+      return k;
+    }
+  }
+  BAIL_ON_BAD_RESULT(VK_ERROR_OUT_OF_DEVICE_MEMORY);
+  return VK_MAX_MEMORY_TYPES;
+}
+
+void RadixSorter::destroyBuffer(Buffer &buffer) {
+  if (buffer.buffer == VK_NULL_HANDLE) {
+    return;
+  }
+  vkDestroyBuffer(device, buffer.buffer, 0);
+  if (buffer.pool != nullptr) {
+    freeToPool(buffer);
+  }
+  else {
+    if (buffer.mapped != nullptr) {
+      vkUnmapMemory(device, buffer.memory);
+    }
+    vkFreeMemory(device, buffer.memory, 0);
+  }
+  buffer = Buffer();
+}
+
+// First fit over the free ranges of the pool's blocks. Without a fit the pool gets a new block of
+// nextBlockSize or the request if that is larger, and the next block will be twice as large.
+void RadixSorter::allocateFromPool(MemoryPool &pool, const VkMemoryRequirements &requirements, Buffer &buffer) {
+  for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+    if (allocateFromBlock(pool, i, requirements, buffer)) {
+      return;
+    }
+  }
+
+  // slots of trimmed blocks are reused, the block index of every live buffer stays valid
+  uint32_t index = 0;
+  while (index < pool.blocks.size() && pool.blocks[index].memory != VK_NULL_HANDLE) {
+    index++;
+  }
+  if (index == pool.blocks.size()) {
+    pool.blocks.emplace_back();
+  }
+  MemoryBlock &block = pool.blocks[index];
+  block.size = std::max(pool.nextBlockSize, requirements.size);
+  VkMemoryAllocateInfo memAllocateInfo = {
+      VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, 0, block.size, pool.typeIndex
+  };
+  // the doubled block may exceed what the heap has left, the request alone may still fit
+  if (vkAllocateMemory(device, &memAllocateInfo, 0, &block.memory) != VK_SUCCESS) {
+    block.size = requirements.size;
+    memAllocateInfo.allocationSize = block.size;
+    BAIL_ON_BAD_RESULT(vkAllocateMemory(device, &memAllocateInfo, 0, &block.memory));
+  }
+  // host visible blocks stay mapped for the lifetime of the block
+  if (pool.hostVisible) {
+    BAIL_ON_BAD_RESULT(vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped));
+  }
+  block.freeRanges[0] = block.size;
+  pool.nextBlockSize = std::max(pool.nextBlockSize, requirements.size) * 2;
+  allocateFromBlock(pool, index, requirements, buffer);
+}
+
+bool RadixSorter::allocateFromBlock(MemoryPool &pool, uint32_t index, const VkMemoryRequirements &requirements, Buffer &buffer) {
+  MemoryBlock &block = pool.blocks[index];
+  for (auto range = block.freeRanges.begin(); range != block.freeRanges.end(); ++range) {
+    const VkDeviceSize rangeStart = range->first;
+    const VkDeviceSize rangeEnd = range->first + range->second;
+    const VkDeviceSize offset = (rangeStart + requirements.alignment - 1) / requirements.alignment * requirements.alignment;
+    if (offset + requirements.size > rangeEnd) {
+      continue;
+    }
+    // the padding in front of the buffer and the rest behind it stay free
+    block.freeRanges.erase(range);
+    if (offset > rangeStart) {
+      block.freeRanges[rangeStart] = offset - rangeStart;
+    }
+    if (offset + requirements.size < rangeEnd) {
+      block.freeRanges[offset + requirements.size] = rangeEnd - offset - requirements.size;
+    }
+    buffer.memory = block.memory;
+    buffer.mapped = block.mapped != nullptr ? (char *) block.mapped + offset : nullptr;
+    buffer.pool = &pool;
+    buffer.block = index;
+    buffer.offset = offset;
+    buffer.allocationSize = requirements.size;
+    pool.usedSize += requirements.size;
+    return true;
+  }
+  return false;
+}
+
+// Releases the blocks nothing lives in once they are larger than everything the pool still holds,
+// so one huge sort does not pin its memory for the lifetime of the sorter. Called after the buffers
+// of a sort are in place rather than on every free, a buffer that grows reuses its old block.
+void RadixSorter::trimPool(MemoryPool &pool) {
+  VkDeviceSize largestBlock = 0;
+  for (MemoryBlock &block : pool.blocks) {
+    if (block.memory == VK_NULL_HANDLE) {
+      continue;
+    }
+    const bool empty = block.freeRanges.size() == 1 && block.freeRanges.begin()->second == block.size;
+    if (empty && block.size > pool.usedSize) {
+      if (block.mapped != nullptr) {
+        vkUnmapMemory(device, block.memory);
+      }
+      vkFreeMemory(device, block.memory, 0);
+      block = MemoryBlock();
+      continue;
+    }
+    largestBlock = std::max(largestBlock, block.size);
+  }
+  // the growth starts over from the largest block left
+  pool.nextBlockSize = std::max(pool.firstBlockSize, 2 * largestBlock);
+}
+
+// Returns the range of a pooled buffer to its block and merges it with free neighbours
+void RadixSorter::freeToPool(Buffer &buffer) {
+  buffer.pool->usedSize -= buffer.allocationSize;
+  std::map<VkDeviceSize, VkDeviceSize> &freeRanges = buffer.pool->blocks[buffer.block].freeRanges;
+  VkDeviceSize offset = buffer.offset;
+  VkDeviceSize size = buffer.allocationSize;
+  auto next = freeRanges.lower_bound(offset);
+  if (next != freeRanges.end() && offset + size == next->first) {
+    size += next->second;
+    next = freeRanges.erase(next);
+  }
+  if (next != freeRanges.begin()) {
+    auto previous = std::prev(next);
+    if (previous->first + previous->second == offset) {
+      offset = previous->first;
+      size += previous->second;
+      freeRanges.erase(previous);
+    }
+  }
+  freeRanges[offset] = size;
+}
+
+// Wraps host memory in a storage buffer through VK_EXT_external_memory_host. Returns false if the
+// driver refuses the pointer, the caller copies the keys instead.
+bool RadixSorter::importHostBuffer(void *pointer, VkDeviceSize size, Buffer &buffer) {
+  VkMemoryHostPointerPropertiesEXT pointerProperties = {};
+  pointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+  if (getMemoryHostPointerProperties(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pointer, &pointerProperties) != VK_SUCCESS) {
+    return false;
+  }
+
+  const VkExternalMemoryBufferCreateInfo externalCreateInfo = {
+      VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO, 0, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT
+  };
+  VkBufferCreateInfo bufferCreateInfo = {
+      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      &externalCreateInfo,
+      0,
+      size,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      1,
+      &queueFamilyIndex
+  };
+  BAIL_ON_BAD_RESULT(vkCreateBuffer(device, &bufferCreateInfo, 0, &buffer.buffer));
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(device, buffer.buffer, &requirements);
+
+  // the host reads the result without invalidating, so only coherent types will do
+  uint32_t importTypeIndex = VK_MAX_MEMORY_TYPES;
+  for (uint32_t k = 0; k < memoryProperties.memoryTypeCount; k++) {
+    if ((pointerProperties.memoryTypeBits & requirements.memoryTypeBits & (1u << k)) &&
+        (VK_MEMORY_PROPERTY_HOST_COHERENT_BIT & memoryProperties.memoryTypes[k].propertyFlags)) {
+      importTypeIndex = k;
+      break;
+    }
+  }
+  const VkImportMemoryHostPointerInfoEXT importInfo = {
+      VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT, 0, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pointer
+  };
+  const VkMemoryAllocateInfo memAllocateInfo = {
+      VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, &importInfo, size, importTypeIndex
+  };
+  if (importTypeIndex == VK_MAX_MEMORY_TYPES || vkAllocateMemory(device, &memAllocateInfo, 0, &buffer.memory) != VK_SUCCESS) {
+    vkDestroyBuffer(device, buffer.buffer, 0);
+    buffer = Buffer();
+    return false;
+  }
+  BAIL_ON_BAD_RESULT(vkBindBufferMemory(device, buffer.buffer, buffer.memory, 0));
+  buffer.size = size;
+  return true;
+}
+
+void RadixSorter::ensureCapacity(size_t length, size_t keySize, bool withValues, std::span<const uint32_t> segmentOffsets) {
+  job->wgCount = ceil((double) length / (double) groupSize);
+  job->wgRows = 1;
+  job->elementsPerWI = 1;
+  if (job->wgCount > maxWgCount) {
+    job->wgCount = maxWgCount;
+    job->elementsPerWI = ceil((double) length / ((double) groupSize * job->wgCount));
+  }
+  const uint32_t radixElements = 1u << radixBits;
+  job->histogramLength = radixElements * job->wgCount;
+  job->tileCount = (length + onesweepTileSize - 1) / onesweepTileSize;
+  job->segmented = !segmentOffsets.empty();
+  if (job->segmented) { // same keys per work group, but the histogram counts pieces
+    packSegments(segmentOffsets, length);
+  }
+
+  // only the staging ring is host visible in the device local mode
+  const bool hostVisible = !deviceLocal;
+  ensureBuffer(job->inputBuffer, keySize * length, hostVisible);
+  ensureBuffer(job->outputBuffer, keySize * length, hostVisible);
+  if (withValues) {
+    ensureBuffer(job->valueInputBuffer, sizeof(uint32_t) * length, hostVisible);
+    ensureBuffer(job->valueOutputBuffer, sizeof(uint32_t) * length, hostVisible);
+  }
+  if (job->segmented) {
+    ensureBuffer(job->segmentPieceBuffer, sizeof(SegmentPiece) * job->segmentPieces.size(), hostVisible);
+    ensureBuffer(job->segmentGroupBuffer, sizeof(uint32_t) * job->segmentGroups.size(), hostVisible);
+  }
+  if (engine == RadixEngine::ONESWEEP) {
+    // the histogram shader counts the digits of every pass, even the ones a narrow key range skips
+    ensureBuffer(job->digitHistogramBuffer, sizeof(uint32_t) * radixElements * ((keySize * 8 + radixBits - 1) / radixBits), hostVisible);
+    ensureBuffer(job->partitionStateBuffer, sizeof(uint32_t) * (1 + radixElements * job->tileCount), hostVisible);
+  }
+  else {
+    ensureBuffer(job->histogramBuffer, sizeof(uint32_t) * job->histogramLength, hostVisible);
+    // every level holds the block totals of the one below until a single block is left
+    job->scanLevels = 0;
+    uint32_t levelLength = job->histogramLength;
+    do {
+      const uint32_t blocks = (levelLength + scanBlockSize - 1) / scanBlockSize;
+      job->scanLengths[job->scanLevels] = levelLength;
+      ensureBuffer(job->scanTotalBuffers[job->scanLevels], sizeof(uint32_t) * blocks, hostVisible);
+      job->scanLevels++;
+      levelLength = blocks;
+    } while (levelLength > 1);
+  }
+
+  VkBuffer current[9 + MAX_SCAN_LEVELS] = {job->inputBuffer.buffer, job->outputBuffer.buffer, job->valueInputBuffer.buffer, job->valueOutputBuffer.buffer,
+                                           job->histogramBuffer.buffer, job->digitHistogramBuffer.buffer, job->partitionStateBuffer.buffer,
+                                           job->segmentPieceBuffer.buffer, job->segmentGroupBuffer.buffer};
+  for (uint32_t i = 0; i < MAX_SCAN_LEVELS; i++) {
+    current[9 + i] = job->scanTotalBuffers[i].buffer;
+  }
+  for (MemoryPool &pool : memoryPools) {
+    trimPool(pool);
+  }
+
+  // compared with the buffers last written rather than the ones before this call, an imported
+  // key buffer is swapped in and out of inputBuffer around ensureCapacity
+  if (memcmp(job->describedBuffers, current, sizeof(current)) != 0) {
+    updateDescriptorSets();
+    memcpy(job->describedBuffers, current, sizeof(current));
+  }
+}
+
+// Cuts the segments into pieces of at most one work group of keys and packs the pieces in key
+// order into work groups of up to maxSegmentPieces, see shaders/radix_common.glsl. A long segment
+// spans several work groups, short ones share one. The work groups run in rows of maxWgCount,
+// the padding groups of the last row get no pieces.
+void RadixSorter::packSegments(std::span<const uint32_t> segmentOffsets, size_t length) {
+  const uint32_t radixElements = 1u << radixBits;
+  const uint32_t groupKeys = groupSize * job->elementsPerWI;
+  std::vector<SegmentPiece> &pieces = job->segmentPieces;
+  std::vector<uint32_t> &groups = job->segmentGroups;
+  pieces.clear();
+  groups.clear();
+
+  uint32_t groupPieces = maxSegmentPieces; // the first piece opens a work group
+  uint32_t groupFill = 0;
+  for (size_t segment = 0; segment < segmentOffsets.size(); segment++) {
+    const uint32_t firstPiece = pieces.size();
+    const uint32_t end = segment + 1 < segmentOffsets.size() ? segmentOffsets[segment + 1] : (uint32_t) length;
+    for (uint32_t start = segmentOffsets[segment]; start < end;) {
+      if (groupPieces == maxSegmentPieces || groupFill == groupKeys) {
+        groups.push_back(pieces.size());
+        groupPieces = 0;
+        groupFill = 0;
+      }
+      const uint32_t pieceLength = std::min(end - start, groupKeys - groupFill);
+      pieces.push_back({start, 0, 0});
+      groupPieces++;
+      groupFill += pieceLength;
+      start += pieceLength;
+    }
+    // the digits of a segment are counted piece after piece, so the scan runs through the segment digit by digit
+    const uint32_t segmentPieces = pieces.size() - firstPiece;
+    for (uint32_t piece = firstPiece; piece < pieces.size(); piece++) {
+      pieces[piece].histogramBase = firstPiece * radixElements + (piece - firstPiece);
+      pieces[piece].digitStride = segmentPieces;
+    }
+  }
+
+  const uint32_t pieceCount = pieces.size();
+  const uint32_t groupCount = groups.size();
+  if ((uint64_t) radixElements * pieceCount > std::min<uint64_t>(UINT32_MAX, (uint64_t) MAX_WG_NUMBER * scanBlockSize)) {
+    std::cout << "Too many segment pieces to scan their digit counts, sort fewer or longer segments at once" << std::endl;
+    exit(-1);
+  }
+  job->wgCount = std::min(groupCount, maxWgCount);
+  job->wgRows = (groupCount + maxWgCount - 1) / maxWgCount;
+  job->histogramLength = radixElements * pieceCount;
+  // the padding groups and the end of the last group point past the last piece, which ends the keys
+  groups.resize((size_t) job->wgCount * job->wgRows + 1, pieceCount);
+  pieces.push_back({(uint32_t) length, 0, 0});
+}
+
+void RadixSorter::updateDescriptorSets() {
+  VkDescriptorBufferInfo inputDescrBufInfo = {job->inputBuffer.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo outputDescrBufInfo = {job->outputBuffer.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo valueInputDescrBufInfo = {job->valueInputBuffer.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo valueOutputDescrBufInfo = {job->valueOutputBuffer.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo histogramDescrBufInfo = {job->histogramBuffer.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo globalPSumTotalsDescrBufInfo = {job->scanTotalBuffers[0].buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo digitHistogramDescrBufInfo = {job->digitHistogramBuffer.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo partitionStateDescrBufInfo = {job->partitionStateBuffer.buffer, 0, VK_WHOLE_SIZE};
+
+  // only the sets of the configured engine are written, the other engine never allocates its buffers
+  const bool onesweep = engine == RadixEngine::ONESWEEP;
+  VkDescriptorBufferInfo *countsInfo = onesweep ? &digitHistogramDescrBufInfo : &histogramDescrBufInfo;
+  VkDescriptorBufferInfo *offsetsInfo = onesweep ? &partitionStateDescrBufInfo : &globalPSumTotalsDescrBufInfo;
+
+  for (uint32_t i = 0; i < 2; i++) {
+    // set 1 swaps source and destination so that consecutive passes ping-pong between the buffers
+    VkDescriptorBufferInfo *srcInfo = i == 0 ? &inputDescrBufInfo : &outputDescrBufInfo;
+    VkDescriptorBufferInfo *dstInfo = i == 0 ? &outputDescrBufInfo : &inputDescrBufInfo;
+    VkDescriptorBufferInfo *valueSrcInfo = i == 0 ? &valueInputDescrBufInfo : &valueOutputDescrBufInfo;
+    VkDescriptorBufferInfo *valueDstInfo = i == 0 ? &valueOutputDescrBufInfo : &valueInputDescrBufInfo;
+
+    // the onesweep histogram only ever reads the keys before the first pass
+    VkDescriptorSet histSet = onesweep ? job->onesweepHistDescSet : job->histDescSets[i];
+    if (!onesweep || i == 0) {
+      VkWriteDescriptorSet writeDescriptorSets[2] = {
+          {
+              VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, histSet, 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, srcInfo,    0
+          },
+          {
+              VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, histSet, 1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, countsInfo, 0
+          }
+      };
+      vkUpdateDescriptorSets(device, 2, writeDescriptorSets, 0, 0);
+    }
+
+    VkDescriptorSet passSet = onesweep ? job->onesweepDescSets[i] : job->reorderDescSets[i];
+    VkWriteDescriptorSet reorderWrite[6] = {
+        {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, passSet, 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, srcInfo,      0},
+        {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, passSet, 1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, dstInfo,      0},
+        {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, passSet, 2, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, countsInfo,   0},
+        {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, passSet, 3, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, offsetsInfo,  0},
+        {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, passSet, 4, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, valueSrcInfo, 0},
+        {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, passSet, 5, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, valueDstInfo, 0}
+    };
+    // the value bindings stay unwritten until the first key-value sort allocates their buffers
+    vkUpdateDescriptorSets(device, job->valueInputBuffer.buffer != VK_NULL_HANDLE ? 6 : 4, reorderWrite, 0, 0);
+
+    // and the segment bindings until the first segmented sort
+    if (!onesweep && job->segmentPieceBuffer.buffer != VK_NULL_HANDLE) {
+      VkDescriptorBufferInfo piecesInfo = {job->segmentPieceBuffer.buffer, 0, VK_WHOLE_SIZE};
+      VkDescriptorBufferInfo groupsInfo = {job->segmentGroupBuffer.buffer, 0, VK_WHOLE_SIZE};
+      VkWriteDescriptorSet segmentWrite[4] = {
+          {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, histSet, 2, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &piecesInfo, 0},
+          {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, histSet, 3, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &groupsInfo, 0},
+          {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, passSet, 6, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &piecesInfo, 0},
+          {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, passSet, 7, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &groupsInfo, 0}
+      };
+      vkUpdateDescriptorSets(device, 4, segmentWrite, 0, 0);
+    }
+  }
+
+  // scan levels without buffers were never needed so far and stay unwritten
+  for (uint32_t i = 0; !onesweep && i < MAX_SCAN_LEVELS && job->scanTotalBuffers[i].buffer != VK_NULL_HANDLE; i++) {
+    VkDescriptorBufferInfo levelInfo = {i == 0 ? job->histogramBuffer.buffer : job->scanTotalBuffers[i - 1].buffer, 0, VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo totalsInfo = {job->scanTotalBuffers[i].buffer, 0, VK_WHOLE_SIZE};
+    VkWriteDescriptorSet scanWrite[2] = {
+        {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, job->scanDescSets[i], 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &levelInfo,  0},
+        {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, job->scanDescSets[i], 1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &totalsInfo, 0}
+    };
+    vkUpdateDescriptorSets(device, 2, scanWrite, 0, 0);
+  }
+}
+
+// Uploads the keys into an idle job slot and submits their sort without waiting for it. Sorts the
+// device would not pay off for are done right here and get a ticket that is already finished.
+SortTicket RadixSorter::sortImpl(void *keys, size_t length, RadixKeyType keyType, uint32_t *values, bool identityValues, bool importKeys, uint32_t keyBits,
+                                 std::span<const uint32_t> segmentOffsets) {
+  if (length == 0) {
+    return ++lastTicket;
+  }
+  if (length > UINT32_MAX) {
+    std::cout << "Can only sort up to " << UINT32_MAX << " elements at once" << std::endl;
+    exit(-1);
+  }
+  if (engine == RadixEngine::ONESWEEP && length > ONESWEEP_MAX_LENGTH) {
+    std::cout << "The onesweep engine can only sort up to " << ONESWEEP_MAX_LENGTH << " elements at once" << std::endl;
+    exit(-1);
+  }
+
+  if (length <= hostSortThreshold) {
+    if (!segmentOffsets.empty()) { // 32 bit keys and no argsort, see sortSegments
+      for (size_t segment = 0; segment < segmentOffsets.size(); segment++) {
+        const size_t begin = segmentOffsets[segment];
+        const size_t end = segment + 1 < segmentOffsets.size() ? segmentOffsets[segment + 1] : length;
+        hostSort((uint32_t *) keys + begin, end - begin, keyType, values != nullptr ? values + begin : nullptr, false);
+      }
+    }
+    else if (isKey64(keyType)) {
+      hostSort((uint64_t *) keys, length, keyType, values, identityValues);
+    }
+    else {
+      hostSort((uint32_t *) keys, length, keyType, values, identityValues);
+    }
+    lastSortTime = 0;
+    stageTimings.clear();
+    return ++lastTicket;
+  }
+
+  // the oldest sort in flight is finished when every slot is taken
+  job = nullptr;
+  for (SortJob &sortJob : jobs) {
+    if (sortJob.ticket == 0) {
+      job = &sortJob;
+      break;
+    }
+    if (job == nullptr || sortJob.ticket < job->ticket) {
+      job = &sortJob;
+    }
+  }
+  if (job->ticket != 0) {
+    finishJob(*job);
+  }
+
+  const bool withValues = values != nullptr;
+  const size_t keySize = isKey64(keyType) ? sizeof(uint64_t) : sizeof(uint32_t);
+  const VkDeviceSize inputMemSize = keySize * length;
+  const VkDeviceSize valueMemSize = sizeof(uint32_t) * length;
+
+  // sortInPlace: the imported keys stand in for inputBuffer until the job is finished, the passes
+  // then read and write the caller's memory directly
+  bool imported = false;
+  if (importKeys && importAlignment != 0 && (uintptr_t) keys % importAlignment == 0) {
+    const VkDeviceSize importSize = (inputMemSize + importAlignment - 1) / importAlignment * importAlignment;
+    imported = importHostBuffer(keys, importSize, job->ownInputBuffer);
+    if (imported) {
+      std::swap(job->inputBuffer, job->ownInputBuffer);
+    }
+  }
+  job->imported = imported;
+  ensureCapacity(length, keySize, withValues, segmentOffsets);
+
+  // copies count keys starting at first to dst, tracking the encoded key range when narrowing
+  uint64_t keyLow = UINT64_MAX;
+  uint64_t keyHigh = 0;
+  auto copyKeys = [&](void *dst, size_t first, size_t count) {
+    if (!narrowKeyRange) {
+      memcpy(dst, (const char *) keys + first * keySize, count * keySize);
+    }
+    else if (keySize == sizeof(uint64_t)) {
+      uploadKeys((const uint64_t *) keys + first, (uint64_t *) dst, count, keyType, keyLow, keyHigh);
+    }
+    else {
+      uploadKeys((const uint32_t *) keys + first, (uint32_t *) dst, count, keyType, keyLow, keyHigh);
+    }
+  };
+  uint64_t uploadValue = 0;
+  job->uploadHistogram = false;
+  if (imported) {
+    if (narrowKeyRange) { // nothing to copy, but the key range is still needed
+      copyKeys(keys, 0, length);
+    }
+  }
+  else if (deviceLocal) {
+    // the first histogram counts the work groups whose keys have all arrived while the host fills
+    // the next chunks. A narrowed range is only known once every key went through the host, and
+    // the work groups of a segmented sort do not cover fixed key ranges.
+    job->uploadHistogram = !narrowKeyRange && !job->segmented;
+    const bool onesweep = engine == RadixEngine::ONESWEEP;
+    const VkDeviceSize groupMemSize = keySize * (onesweep ? onesweepTileSize : groupSize * job->elementsPerWI);
+    const uint32_t groupCount = onesweep ? job->tileCount : job->wgCount;
+    uint32_t uploadBatches = 0;
+    uint32_t countedGroups = 0;
+    uploadValue = stagedUpload(job->inputBuffer.buffer, inputMemSize, [&](void *staging, VkDeviceSize offset, VkDeviceSize size) {
+      copyKeys(staging, offset / keySize, size / keySize);
+    }, [&](VkDeviceSize uploaded, uint64_t copyValue) {
+      const uint32_t groups = uploaded == inputMemSize ? groupCount : (uint32_t) (uploaded / groupMemSize);
+      if (job->uploadHistogram && groups > countedGroups) {
+        submitUploadHistogram(uploadBatches++, countedGroups, groups, (uint32_t) length, keyType, copyValue);
+        countedGroups = groups;
+      }
+    });
+  }
+  else {
+    copyKeys(job->inputBuffer.mapped, 0, length);
+  }
+
+  // the first pass subtracts the smallest key and the last adds it back, so the passes only
+  // cover the bits of the largest key minus the smallest
+  uint32_t passes = (keyBits + radixBits - 1) / radixBits;
+  job->keyBias = 0;
+  if (narrowKeyRange) {
+    uint32_t rangeBits = 0;
+    for (uint64_t range = keyHigh - keyLow; range != 0; range >>= 1) {
+      rangeBits++;
+    }
+    passes = (rangeBits + radixBits - 1) / radixBits;
+    job->keyBias = keyLow;
+  }
+
+  if (passes == 0) { // every key is the same, the input is already sorted
+    releaseImport(*job);
+    lastSortTime = 0;
+    stageTimings.clear();
+    if (identityValues) {
+      for (size_t i = 0; i < length; i++) {
+        values[i] = i;
+      }
+    }
+    return ++lastTicket;
+  }
+
+  // the pieces of the segments and the work groups they were packed into, see packSegments
+  if (job->segmented) {
+    const VkDeviceSize pieceMemSize = sizeof(SegmentPiece) * job->segmentPieces.size();
+    const VkDeviceSize segmentGroupMemSize = sizeof(uint32_t) * job->segmentGroups.size();
+    if (deviceLocal) {
+      stagedUpload(job->segmentPieceBuffer.buffer, pieceMemSize, [&](void *staging, VkDeviceSize offset, VkDeviceSize size) {
+        memcpy(staging, (const char *) job->segmentPieces.data() + offset, size);
+      });
+      uploadValue = stagedUpload(job->segmentGroupBuffer.buffer, segmentGroupMemSize, [&](void *staging, VkDeviceSize offset, VkDeviceSize size) {
+        memcpy(staging, (const char *) job->segmentGroups.data() + offset, size);
+      });
+    }
+    else {
+      memcpy(job->segmentPieceBuffer.mapped, job->segmentPieces.data(), pieceMemSize);
+      memcpy(job->segmentGroupBuffer.mapped, job->segmentGroups.data(), segmentGroupMemSize);
+    }
+  }
+
+  // the argsort mode never uploads values, the first reorder pass generates them
+  if (withValues && !identityValues) {
+    if (deviceLocal) {
+      uploadValue = stagedUpload(job->valueInputBuffer.buffer, valueMemSize, [&](void *staging, VkDeviceSize offset, VkDeviceSize size) {
+        memcpy(staging, (const char *) values + offset, size);
+      });
+    }
+    else {
+      memcpy(job->valueInputBuffer.mapped, values, valueMemSize);
+    }
+  }
+
+  // an odd number of passes leaves the result in outputBuffer, the device copies it back into imported keys
+  recordSort(passes, (uint32_t) length, keyType, withValues, identityValues, imported && passes % 2);
+
+  VkSubmitInfo submitInfo = {
+      VK_STRUCTURE_TYPE_SUBMIT_INFO, 0, 0, 0, 0, 1, &job->commandBuffer, 0, 0
+  };
+  // in the device local mode the sort waits for the last staged copy. It signals nothing, the
+  // readback in finishJob only starts after the fence, so the transfer queue stays the only
+  // queue signalling the timeline and its values keep increasing while other sorts upload.
+  const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  const VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+      VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, 0, 1, &uploadValue, 0, 0
+  };
+  if (deviceLocal) {
+    submitInfo.pNext = &timelineSubmitInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &timeline;
+    submitInfo.pWaitDstStageMask = &waitStage;
+  }
+
+  job->submitTime = std::chrono::high_resolution_clock::now();
+  BAIL_ON_BAD_RESULT(vkQueueSubmit(queue, 1, &submitInfo, job->fence));
+
+  job->keys = keys;
+  job->values = withValues ? values : nullptr;
+  job->keyMemSize = inputMemSize;
+  job->valueMemSize = valueMemSize;
+  job->passes = passes;
+  job->ticket = ++lastTicket;
+  return job->ticket;
+}
+
+// Waits for the sort of a job slot and copies its result back to the caller's arrays
+void RadixSorter::finishJob(SortJob &sortJob) {
+  job = &sortJob;
+  BAIL_ON_BAD_RESULT(vkWaitForFences(device, 1, &job->fence, VK_TRUE, UINT64_MAX));
+  auto stop = std::chrono::high_resolution_clock::now();
+  lastSortTime = std::chrono::duration_cast<std::chrono::milliseconds>(stop - job->submitTime).count();
+  BAIL_ON_BAD_RESULT(vkResetFences(device, 1, &job->fence));
+  vkResetCommandBuffer(job->commandBuffer, 0);
+  readTimestamps();
+  stageTimings = job->timings;
+  job->ticket = 0;
+
+  if (job->imported) {
+    releaseImport(*job);
+    return;
+  }
+
+  // every pass flips the buffers, so after an odd number of passes the result sits in the output buffers
+  const Buffer &keyResult = job->passes % 2 ? job->outputBuffer : job->inputBuffer;
+  const Buffer &valueResult = job->passes % 2 ? job->valueOutputBuffer : job->valueInputBuffer;
+  if (deviceLocal) {
+    stagedDownload(keyResult.buffer, job->keyMemSize, job->keys, 0);
+    if (job->values != nullptr) {
+      stagedDownload(valueResult.buffer, job->valueMemSize, job->values, 0);
+    }
+    return;
+  }
+  memcpy(job->keys, keyResult.mapped, job->keyMemSize);
+  if (job->values != nullptr) {
+    memcpy(job->values, valueResult.mapped, job->valueMemSize);
+  }
+}
+
+// Puts the job's own key buffer back in place of the imported keys
+void RadixSorter::releaseImport(SortJob &sortJob) {
+  if (sortJob.imported) {
+    std::swap(sortJob.inputBuffer, sortJob.ownInputBuffer);
+    destroyBuffer(sortJob.ownInputBuffer);
+    sortJob.imported = false;
+  }
+}
+
+// Tickets above lastTicket were never handed out, a ticket without a job is already finished
+void RadixSorter::checkTicket(SortTicket ticket) const {
+  if (ticket == 0 || ticket > lastTicket) {
+    std::cout << "Unknown sort ticket " << ticket << ", the last one issued is " << lastTicket << std::endl;
+    exit(-1);
+  }
+}
+
+void RadixSorter::wait(SortTicket ticket) {
+  checkTicket(ticket);
+  for (SortJob &sortJob : jobs) {
+    if (sortJob.ticket == ticket) {
+      finishJob(sortJob);
+    }
+  }
+}
+
+bool RadixSorter::finished(SortTicket ticket) {
+  checkTicket(ticket);
+  for (SortJob &sortJob : jobs) {
+    if (sortJob.ticket == ticket) {
+      const VkResult status = vkGetFenceStatus(device, sortJob.fence);
+      if (status == VK_NOT_READY) {
+        return false;
+      }
+      BAIL_ON_BAD_RESULT(status);
+      finishJob(sortJob);
+    }
+  }
+  return true;
+}
+
+void RadixSorter::sortSegmentsImpl(uint32_t *keys, size_t length, RadixKeyType keyType, std::span<const uint32_t> segmentOffsets, uint32_t *values) {
+  if (engine != RadixEngine::MULTI_PASS) {
+    std::cout << "Segmented sorts run on the multi pass engine only" << std::endl;
+    exit(-1);
+  }
+  if (maxSegmentPieces == 0) {
+    std::cout << "The segmented reorder does not fit into the shared memory of the device, lower groupSize or radixBits" << std::endl;
+    exit(-1);
+  }
+  if (!segmentOffsets.empty() && segmentOffsets[0] != 0) {
+    std::cout << "The first segment has to start at offset 0" << std::endl;
+    exit(-1);
+  }
+  for (size_t segment = 0; segment < segmentOffsets.size(); segment++) {
+    const size_t end = segment + 1 < segmentOffsets.size() ? segmentOffsets[segment + 1] : length;
+    if (end < segmentOffsets[segment] || end > length) {
+      std::cout << "The segment offsets have to be ascending and within the keys" << std::endl;
+      exit(-1);
+    }
+  }
+
+  // no offsets is a single segment, an ordinary sort
+  wait(sortImpl(keys, length, keyType, values, false, false, 32, segmentOffsets));
+}
+
+// Streams size bytes into dst through the staging ring. fill writes bytes [offset, offset + size)
+// of the source into a slot, so the caller can transform keys on the way. The host fills the next
+// slot while the transfer queue copies the previous ones. copied gets the end of the bytes submitted
+// so far and the timeline value of their last copy. Returns the timeline value of the last copy.
+uint64_t RadixSorter::stagedUpload(VkBuffer dst, VkDeviceSize size,
+                                   const std::function<void(void *, VkDeviceSize, VkDeviceSize)> &fill,
+                                   const std::function<void(VkDeviceSize, uint64_t)> &copied) {
+  uint32_t slot = 0;
+  for (VkDeviceSize offset = 0; offset < size; offset += stagingChunkSize) {
+    const VkDeviceSize chunkSize = std::min(stagingChunkSize, size - offset);
+    waitTimeline(slotValues[slot]); // the copy that used the slot before has to be done
+    fill((char *) stagingBuffer.mapped + slot * stagingChunkSize, offset, chunkSize);
+    submitStagingCopy(slot, dst, offset, chunkSize, true, 0);
+    if (copied) {
+      copied(offset + chunkSize, slotValues[slot]);
+    }
+    slot = (slot + 1) % STAGING_SLOTS;
+  }
+  return timelineValue;
+}
+
+// Streams size bytes out of src once the timeline reaches waitValue. Every slot has a copy in
+// flight while the host drains the oldest one.
+void RadixSorter::stagedDownload(VkBuffer src, VkDeviceSize size, void *dst, uint64_t waitValue) {
+  const VkDeviceSize chunks = (size + stagingChunkSize - 1) / stagingChunkSize;
+  for (VkDeviceSize chunk = 0; chunk < std::min<VkDeviceSize>(chunks, STAGING_SLOTS); chunk++) {
+    waitTimeline(slotValues[chunk]); // the slot's command buffer may still be pending from an upload
+    submitStagingCopy(chunk, src, chunk * stagingChunkSize, std::min(stagingChunkSize, size - chunk * stagingChunkSize), false, waitValue);
+  }
+  for (VkDeviceSize chunk = 0; chunk < chunks; chunk++) {
+    const uint32_t slot = chunk % STAGING_SLOTS;
+    const VkDeviceSize offset = chunk * stagingChunkSize;
+    waitTimeline(slotValues[slot]);
+    memcpy((char *) dst + offset, (char *) stagingBuffer.mapped + slot * stagingChunkSize, std::min(stagingChunkSize, size - offset));
+    const VkDeviceSize next = chunk + STAGING_SLOTS;
+    if (next < chunks) {
+      submitStagingCopy(slot, src, next * stagingChunkSize, std::min(stagingChunkSize, size - next * stagingChunkSize), false, waitValue);
+    }
+  }
+}
+
+// Copies between a staging slot and buffer on the transfer queue. The submission waits for
+// waitValue if it is not 0 and signals the next timeline value, which is kept in slotValues.
+void RadixSorter::submitStagingCopy(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, bool upload, uint64_t waitValue) {
+  const VkCommandBuffer transferCommandBuffer = transferCommandBuffers[slot];
+  const VkDeviceSize slotOffset = slot * stagingChunkSize;
+  VkCommandBufferBeginInfo commandBufferBeginInfo = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, 0, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, 0
+  };
+  BAIL_ON_BAD_RESULT(vkBeginCommandBuffer(transferCommandBuffer, &commandBufferBeginInfo));
+  if (upload) {
+    const VkBufferCopy region = {slotOffset, offset, size};
+    vkCmdCopyBuffer(transferCommandBuffer, stagingBuffer.buffer, buffer, 1, &region);
+  }
+  else {
+    const VkBufferCopy region = {offset, slotOffset, size};
+    vkCmdCopyBuffer(transferCommandBuffer, buffer, stagingBuffer.buffer, 1, &region);
+    // the host reads the slot once the timeline value is reached
+    VkMemoryBarrier hostBarrier = {
+        VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT
+    };
+    vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+  }
+  BAIL_ON_BAD_RESULT(vkEndCommandBuffer(transferCommandBuffer));
+
+  slotValues[slot] = ++timelineValue;
+  const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  const VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+      VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, 0, waitValue != 0 ? 1u : 0u, &waitValue, 1, &slotValues[slot]
+  };
+  const VkSubmitInfo submitInfo = {
+      VK_STRUCTURE_TYPE_SUBMIT_INFO, &timelineSubmitInfo, waitValue != 0 ? 1u : 0u, &timeline, &waitStage,
+      1, &transferCommandBuffer, 1, &timeline
+  };
+  BAIL_ON_BAD_RESULT(vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+}
+
+void RadixSorter::waitTimeline(uint64_t value) {
+  if (value == 0) {
+    return;
+  }
+  const VkSemaphoreWaitInfo waitInfo = {
+      VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, 0, 0, 1, &timeline, &value
+  };
+  BAIL_ON_BAD_RESULT(vkWaitSemaphores(device, &waitInfo, UINT64_MAX));
+}
+
+// Counts the first digit of the work groups [firstGroup, endGroup) once the timeline reaches the
+// copy that completed their keys, tiles for the onesweep engine. The ranged dispatches write the
+// same histogram the whole first pass would, so commandBuffer goes on with the scan. Submitted
+// ahead of the sort on the compute queue, its first barrier covers these batches too.
+void RadixSorter::submitUploadHistogram(uint32_t batch, uint32_t firstGroup, uint32_t endGroup, uint32_t length, RadixKeyType keyType,
+                                        uint64_t waitValue) {
+  if (batch == job->uploadCommandBuffers.size()) {
+    const VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, 0, commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1
+    };
+    job->uploadCommandBuffers.emplace_back();
+    BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &job->uploadCommandBuffers.back()));
+  }
+  const VkCommandBuffer commandBuffer = job->uploadCommandBuffers[batch];
+  VkCommandBufferBeginInfo commandBufferBeginInfo = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, 0, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, 0
+  };
+  BAIL_ON_BAD_RESULT(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+
+  // the key range is not narrowed, so there is no bias to subtract
+  const bool key64 = isKey64(keyType);
+  const uint32_t flags = keyTypeFlags(keyType) | FLAG_ENCODE_KEYS;
+  if (engine == RadixEngine::ONESWEEP) {
+    // the digit counts of all passes add up over the batches
+    if (firstGroup == 0) {
+      vkCmdFillBuffer(commandBuffer, job->digitHistogramBuffer.buffer, 0, job->digitHistogramBuffer.size, 0);
+      const VkBufferMemoryBarrier barrier = {
+          VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+          queueFamilyIndex, queueFamilyIndex, job->digitHistogramBuffer.buffer, 0, job->digitHistogramBuffer.size
+      };
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+    // the groups stride over the tiles up to endGroup, which is handed over as the tile count
+    const PushConsts pushConsts = {length, endGroup, 0, 1, flags, 0, 0};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[key64 ? 9 : 8]);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, histogramPipelineLayout, 0, 1, &job->onesweepHistDescSet, 0, 0);
+    vkCmdPushConstants(commandBuffer, histogramPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConsts), &pushConsts);
+    vkCmdDispatchBase(commandBuffer, firstGroup, 0, 0, std::min<uint32_t>(endGroup - firstGroup, MAX_WG_NUMBER), 1, 1);
+  }
+  else {
+    const PushConsts pushConsts = {length, job->histogramLength, 0, job->elementsPerWI, flags, 0, 0};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[key64 ? 1 : 0]);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, histogramPipelineLayout, 0, 1, &job->histDescSets[0], 0, 0);
+    vkCmdPushConstants(commandBuffer, histogramPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConsts), &pushConsts);
+    vkCmdDispatchBase(commandBuffer, firstGroup, 0, 0, endGroup - firstGroup, 1, 1);
+  }
+  BAIL_ON_BAD_RESULT(vkEndCommandBuffer(commandBuffer));
+
+  const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+  const VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+      VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, 0, 1, &waitValue, 0, 0
+  };
+  const VkSubmitInfo submitInfo = {
+      VK_STRUCTURE_TYPE_SUBMIT_INFO, &timelineSubmitInfo, 1, &timeline, &waitStage, 1, &commandBuffer, 0, 0
+  };
+  BAIL_ON_BAD_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+}
+
+void RadixSorter::recordSort(uint32_t passes, uint32_t length, RadixKeyType keyType, bool withValues, bool identityValues, bool resultToInput) {
+  VkCommandBufferBeginInfo commandBufferBeginInfo = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, 0, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, 0
+  };
+  BAIL_ON_BAD_RESULT(vkBeginCommandBuffer(job->commandBuffer, &commandBufferBeginInfo));
+  job->timings.clear();
+  if (stageTimestamps) {
+    vkCmdResetQueryPool(job->commandBuffer, job->timestampPool, 0, timestampCapacity);
+    vkCmdWriteTimestamp(job->commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, job->timestampPool, 0);
+  }
+  if (engine == RadixEngine::ONESWEEP) {
+    recordOnesweep(passes, length, keyType, withValues, identityValues);
+  }
+  else {
+    for (uint32_t i = 0; i < passes; i++) {
+      recordPass(i, passes, length, keyType, withValues, identityValues);
+    }
+  }
+
+  if (resultToInput) {
+    VkMemoryBarrier copyBarrier = {
+        VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT
+    };
+    vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+    const VkBufferCopy region = {0, 0, (isKey64(keyType) ? sizeof(uint64_t) : sizeof(uint32_t)) * (VkDeviceSize) length};
+    vkCmdCopyBuffer(job->commandBuffer, job->outputBuffer.buffer, job->inputBuffer.buffer, 1, &region);
+    recordTimestamp(RadixStage::COPY, -1);
+  }
+
+  // the host reads the result straight out of the mapped buffers once the fence signals
+  VkMemoryBarrier hostBarrier = {
+      VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT
+  };
+  vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                       0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+  BAIL_ON_BAD_RESULT(vkEndCommandBuffer(job->commandBuffer));
+}
+
+void RadixSorter::recordPass(uint32_t pass, uint32_t passes, uint32_t length, RadixKeyType keyType, bool withValues, bool identityValues) {
+  const bool key64 = isKey64(keyType);
+  const VkDeviceSize inputMemSize = (key64 ? sizeof(uint64_t) : sizeof(uint32_t)) * length;
+  const VkDeviceSize valueMemSize = sizeof(uint32_t) * length;
+  const VkDeviceSize histogramMemSize = sizeof(uint32_t) * job->histogramLength;
+  const VkPipeline histogramPipeline = job->segmented ? pipelines[SEGMENTED_FIRST_SHADER] : pipelines[key64 ? 1 : 0];
+  const VkPipeline reorderPipeline = job->segmented ? pipelines[SEGMENTED_FIRST_SHADER + 1 + (withValues ? 1 : 0)] :
+                                     pipelines[4 + (key64 ? 2 : 0) + (withValues ? 1 : 0)];
+  const VkBuffer keyDst = pass % 2 ? job->inputBuffer.buffer : job->outputBuffer.buffer;
+  const VkBuffer valueDst = pass % 2 ? job->valueInputBuffer.buffer : job->valueOutputBuffer.buffer;
+
+  uint32_t startBit = (radixBits * pass);
+  uint32_t flags = keyTypeFlags(keyType);
+  if (pass == 0) {
+    flags |= FLAG_ENCODE_KEYS;
+    // in argsort mode the first pass takes the element index as the value instead of reading the value buffer
+    if (identityValues) {
+      flags |= FLAG_IDENTITY_VALUES;
+    }
+  }
+  if (pass == passes - 1) {
+    flags |= FLAG_DECODE_KEYS;
+  }
+  PushConsts pushConsts = {length, job->histogramLength, startBit, job->elementsPerWI, flags,
+                           (uint32_t) job->keyBias, (uint32_t) (job->keyBias >> 32)};
+
+  // RECORD HISTOGRAM PIPELINE
+  // the first histogram may already be counted during the upload, see submitUploadHistogram
+  if (pass != 0 || !job->uploadHistogram) {
+    vkCmdBindPipeline(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, histogramPipeline);
+    vkCmdBindDescriptorSets(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, histogramPipelineLayout, 0, 1, &job->histDescSets[pass % 2], 0, 0);
+    vkCmdPushConstants(job->commandBuffer, histogramPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConsts), &pushConsts);
+    vkCmdDispatch(job->commandBuffer, job->wgCount, job->wgRows, 1);
+    recordTimestamp(RadixStage::HISTOGRAM, pass);
+  }
+  // RECORD HISTOGRAM PIPELINE - END
+
+  // ADD BUFFER BARRIER
+  // GPUs are free to reschedule ordering of commands in command buffers which means that we must put a barrier
+  // if one command is dependent on another command's results
+  VkBufferMemoryBarrier barrier = {
+      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+      queueFamilyIndex, queueFamilyIndex, job->histogramBuffer.buffer, 0, histogramMemSize
+  };
+  vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 0, nullptr, 1, &barrier, 0, nullptr);
+  // ADD BUFFER BARRIER - END
+
+  // RECORD SCAN AND GLOBAL SUMS PIPELINES
+  recordExclusiveScan(pass);
+  // RECORD SCAN AND GLOBAL SUMS PIPELINES - END
+
+  // BUFFER BARRIER
+  barrier = {
+      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+      queueFamilyIndex, queueFamilyIndex, job->histogramBuffer.buffer, 0, histogramMemSize
+  };
+  vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 0, nullptr, 1, &barrier, 0, nullptr);
+  // BUFFER BARRIER - END
+
+  // RECORD REORDER PIPELINE
+  pushConsts.sumArrLength = job->histogramLength;
+  vkCmdBindPipeline(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reorderPipeline);
+  vkCmdBindDescriptorSets(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reorderPipelineLayout, 0, 1, &job->reorderDescSets[pass % 2], 0, 0);
+  vkCmdPushConstants(job->commandBuffer, reorderPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConsts), &pushConsts);
+  vkCmdDispatch(job->commandBuffer, job->wgCount, job->wgRows, 1);
+  recordTimestamp(RadixStage::REORDER, pass);
+  // RECORD REORDER PIPELINE - END
+
+  // BUFFER BARRIER
+  barrier = {
+      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+      queueFamilyIndex, queueFamilyIndex, keyDst, 0, inputMemSize
+  };
+  vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 0, nullptr, 1, &barrier, 0, nullptr);
+  if (withValues) {
+    barrier.buffer = valueDst;
+    barrier.size = valueMemSize;
+    vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+  }
+  // BUFFER BARRIER - END
+}
+
+// Exclusive scan of the histogramLength buckets in histogramBuffer for any length. The levels scan
+// their blocks upwards, each one into the block totals the next level scans, until a single block
+// is left. The scanned totals are then added back downwards by radix_globalsums.
+void RadixSorter::recordExclusiveScan(uint32_t pass) {
+  const VkMemoryBarrier levelBarrier = {
+      VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+  };
+  PushConsts pushConsts = {0, 0, 0, 0, 0, 0, 0};
+
+  vkCmdBindPipeline(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[2]);
+  for (uint32_t level = 0; level < job->scanLevels; level++) {
+    if (level > 0) {
+      vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+    }
+    pushConsts.sumArrLength = job->scanLengths[level];
+    vkCmdBindDescriptorSets(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scanPipelineLayout, 0, 1, &job->scanDescSets[level], 0, 0);
+    vkCmdPushConstants(job->commandBuffer, scanPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConsts), &pushConsts);
+    vkCmdDispatch(job->commandBuffer, (job->scanLengths[level] + scanBlockSize - 1) / scanBlockSize, 1, 1);
+  }
+  recordTimestamp(RadixStage::SCAN, pass);
+
+  // the top level is a single block and already complete
+  const uint32_t addGroupSize = groupSize * globalSumsElementsPerWI;
+  vkCmdBindPipeline(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[3]);
+  for (uint32_t level = job->scanLevels - 1; level-- > 0;) {
+    vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+    pushConsts.sumArrLength = job->scanLengths[level];
+    vkCmdBindDescriptorSets(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scanPipelineLayout, 0, 1, &job->scanDescSets[level], 0, 0);
+    vkCmdPushConstants(job->commandBuffer, scanPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConsts), &pushConsts);
+    vkCmdDispatch(job->commandBuffer, (job->scanLengths[level] + addGroupSize - 1) / addGroupSize, 1, 1);
+  }
+  recordTimestamp(RadixStage::GLOBAL_SUMS, pass);
+}
+
+void RadixSorter::recordOnesweep(uint32_t passes, uint32_t length, RadixKeyType keyType, bool withValues, bool identityValues) {
+  const bool key64 = isKey64(keyType);
+  const VkDeviceSize inputMemSize = (key64 ? sizeof(uint64_t) : sizeof(uint32_t)) * length;
+  const VkDeviceSize valueMemSize = sizeof(uint32_t) * length;
+  const VkDeviceSize digitHistogramMemSize = job->digitHistogramBuffer.size;
+  const VkDeviceSize partitionStateMemSize = sizeof(uint32_t) * (1 + (1u << radixBits) * job->tileCount);
+  const VkPipeline onesweepPipeline = pipelines[10 + (key64 ? 2 : 0) + (withValues ? 1 : 0)];
+  // tile indices come from an atomic counter, so the dispatch shape only has to cover enough groups
+  const uint32_t groupsX = std::min<uint32_t>(job->tileCount, MAX_WG_NUMBER);
+  const uint32_t groupsY = (job->tileCount + MAX_WG_NUMBER - 1) / MAX_WG_NUMBER;
+
+  // RECORD DIGIT HISTOGRAM PIPELINE
+  // the digit counts may already be taken during the upload, see submitUploadHistogram
+  VkBufferMemoryBarrier barrier;
+  PushConsts pushConsts;
+  if (!job->uploadHistogram) {
+    vkCmdFillBuffer(job->commandBuffer, job->digitHistogramBuffer.buffer, 0, digitHistogramMemSize, 0);
+    barrier = {
+        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        queueFamilyIndex, queueFamilyIndex, job->digitHistogramBuffer.buffer, 0, digitHistogramMemSize
+    };
+    vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    pushConsts = {length, job->tileCount, 0, 1, keyTypeFlags(keyType) | FLAG_ENCODE_KEYS,
+                  (uint32_t) job->keyBias, (uint32_t) (job->keyBias >> 32)};
+    vkCmdBindPipeline(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[key64 ? 9 : 8]);
+    vkCmdBindDescriptorSets(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, histogramPipelineLayout, 0, 1, &job->onesweepHistDescSet, 0, 0);
+    vkCmdPushConstants(job->commandBuffer, histogramPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConsts), &pushConsts);
+    vkCmdDispatch(job->commandBuffer, groupsX, 1, 1);
+    recordTimestamp(RadixStage::ONESWEEP_HISTOGRAM, -1);
+  }
+
+  barrier = {
+      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+      queueFamilyIndex, queueFamilyIndex, job->digitHistogramBuffer.buffer, 0, digitHistogramMemSize
+  };
+  vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 0, nullptr, 1, &barrier, 0, nullptr);
+  // RECORD DIGIT HISTOGRAM PIPELINE - END
+
+  for (uint32_t pass = 0; pass < passes; pass++) {
+    const VkBuffer keyDst = pass % 2 ? job->inputBuffer.buffer : job->outputBuffer.buffer;
+    const VkBuffer valueDst = pass % 2 ? job->valueInputBuffer.buffer : job->valueOutputBuffer.buffer;
+
+    // RESET PARTITION STATE
+    // the previous pass still has to be done with the look-back words before they are cleared
+    barrier = {
+        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        queueFamilyIndex, queueFamilyIndex, job->partitionStateBuffer.buffer, 0, partitionStateMemSize
+    };
+    vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+    vkCmdFillBuffer(job->commandBuffer, job->partitionStateBuffer.buffer, 0, partitionStateMemSize, 0);
+    barrier = {
+        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        queueFamilyIndex, queueFamilyIndex, job->partitionStateBuffer.buffer, 0, partitionStateMemSize
+    };
+    vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+    // RESET PARTITION STATE - END
+
+    // RECORD ONESWEEP PIPELINE
+    uint32_t flags = keyTypeFlags(keyType);
+    if (pass == 0) {
+      flags |= FLAG_ENCODE_KEYS;
+      if (identityValues) {
+        flags |= FLAG_IDENTITY_VALUES;
+      }
+    }
+    if (pass == passes - 1) {
+      flags |= FLAG_DECODE_KEYS;
+    }
+    pushConsts = {length, job->tileCount, radixBits * pass, 1, flags, (uint32_t) job->keyBias, (uint32_t) (job->keyBias >> 32)};
+    vkCmdBindPipeline(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, onesweepPipeline);
+    vkCmdBindDescriptorSets(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reorderPipelineLayout, 0, 1, &job->onesweepDescSets[pass % 2], 0, 0);
+    vkCmdPushConstants(job->commandBuffer, reorderPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConsts), &pushConsts);
+    vkCmdDispatch(job->commandBuffer, groupsX, groupsY, 1);
+    recordTimestamp(RadixStage::ONESWEEP, pass);
+    // RECORD ONESWEEP PIPELINE - END
+
+    // BUFFER BARRIER
+    barrier = {
+        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+        queueFamilyIndex, queueFamilyIndex, keyDst, 0, inputMemSize
+    };
+    vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+    if (withValues) {
+      barrier.buffer = valueDst;
+      barrier.size = valueMemSize;
+      vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+    // BUFFER BARRIER - END
+  }
+}
+
+// Marks the end of a stage. The bottom of pipe timestamp is written once all earlier commands are done,
+// and the barriers between the stages keep them from overlapping.
+void RadixSorter::recordTimestamp(RadixStage stage, int32_t pass) {
+  if (!stageTimestamps) {
+    return;
+  }
+  vkCmdWriteTimestamp(job->commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, job->timestampPool, job->timings.size() + 1);
+  job->timings.push_back({stage, pass, 0});
+}
+
+void RadixSorter::readTimestamps() {
+  if (job->timings.empty()) {
+    return;
+  }
+  std::vector<uint64_t> ticks(job->timings.size() + 1);
+  BAIL_ON_BAD_RESULT(vkGetQueryPoolResults(device, job->timestampPool, 0, ticks.size(), sizeof(uint64_t) * ticks.size(), ticks.data(),
+                                           sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+  for (size_t i = 0; i < job->timings.size(); i++) {
+    // timestampPeriod is in nanoseconds per tick
+    job->timings[i].millis = ((ticks[i + 1] - ticks[i]) & timestampMask) * timestampPeriod / 1e6;
+  }
+}
+
+double RadixSorter::lastStageMillis(RadixStage stage) const {
+  double millis = 0;
+  for (const RadixStageTiming &timing : stageTimings) {
+    if (timing.stage == stage) {
+      millis += timing.millis;
+    }
+  }
+  return millis;
+}
+
+std::string RadixSorter::lastStageTimingsJson() const {
+  const RadixStage stages[] = {RadixStage::HISTOGRAM, RadixStage::SCAN, RadixStage::GLOBAL_SUMS, RadixStage::REORDER,
+                               RadixStage::ONESWEEP_HISTOGRAM, RadixStage::ONESWEEP, RadixStage::COPY};
+  double totalMillis = 0;
+  std::vector<double> passMillis;
+  for (const RadixStageTiming &timing : stageTimings) {
+    totalMillis += timing.millis;
+    if (timing.pass >= 0) {
+      passMillis.resize(std::max<size_t>(passMillis.size(), timing.pass + 1));
+      passMillis[timing.pass] += timing.millis;
+    }
+  }
+
+  std::ostringstream json;
+  json << "{\"totalMillis\": " << totalMillis << ", \"stages\": {";
+  bool first = true;
+  for (RadixStage stage : stages) {
+    const bool present = std::any_of(stageTimings.begin(), stageTimings.end(), [stage](const RadixStageTiming &timing) {
+      return timing.stage == stage;
+    });
+    if (present) {
+      json << (first ? "" : ", ") << "\"" << radixStageName(stage) << "\": " << lastStageMillis(stage);
+      first = false;
+    }
+  }
+  json << "}, \"passes\": [";
+  for (size_t i = 0; i < passMillis.size(); i++) {
+    json << (i ? ", " : "") << passMillis[i];
+  }
+  json << "], \"dispatches\": [";
+  for (size_t i = 0; i < stageTimings.size(); i++) {
+    json << (i ? ", " : "") << "{\"stage\": \"" << radixStageName(stageTimings[i].stage) << "\", \"pass\": "
+         << stageTimings[i].pass << ", \"millis\": " << stageTimings[i].millis << "}";
+  }
+  json << "]}";
+  return json.str();
+}
+
+const char *radixStageName(RadixStage stage) {
+  switch (stage) {
+    case RadixStage::HISTOGRAM:
+      return "histogram";
+    case RadixStage::SCAN:
+      return "scan";
+    case RadixStage::GLOBAL_SUMS:
+      return "global_sums";
+    case RadixStage::REORDER:
+      return "reorder";
+    case RadixStage::ONESWEEP_HISTOGRAM:
+      return "onesweep_histogram";
+    case RadixStage::ONESWEEP:
+      return "onesweep";
+    default:
+      return "copy";
+  }
+}
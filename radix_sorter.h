@@ -0,0 +1,527 @@
+//
+// Vulkan LSD radix sort with a persistent context. The instance, device, shader modules
+// and pipelines are created once; buffers grow with the input and are reused afterwards.
+//
+
+#ifndef RADIXCOMPUTE_RADIX_SORTER_H
+#define RADIXCOMPUTE_RADIX_SORTER_H
+
+#include "vulkan/vulkan.h"
+
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+enum class RadixKeyType {
+  UINT32,
+  INT32,
+  FLOAT,
+  UINT64,
+  INT64,
+  DOUBLE
+};
+
+template<typename K>
+struct RadixKeyTraits;
+
+template<>
+struct RadixKeyTraits<uint32_t> {
+  static constexpr RadixKeyType type = RadixKeyType::UINT32;
+};
+
+template<>
+struct RadixKeyTraits<int32_t> {
+  static constexpr RadixKeyType type = RadixKeyType::INT32;
+};
+
+template<>
+struct RadixKeyTraits<float> {
+  static constexpr RadixKeyType type = RadixKeyType::FLOAT;
+};
+
+template<>
+struct RadixKeyTraits<uint64_t> {
+  static constexpr RadixKeyType type = RadixKeyType::UINT64;
+};
+
+template<>
+struct RadixKeyTraits<int64_t> {
+  static constexpr RadixKeyType type = RadixKeyType::INT64;
+};
+
+template<>
+struct RadixKeyTraits<double> {
+  static constexpr RadixKeyType type = RadixKeyType::DOUBLE;
+};
+
+// Maps the bits of a key to unsigned bits with the same order. Host side copy of
+// encodeKey/encodeKey64 in shaders/radix_common.glsl.
+template<typename U>
+inline U encodeKeyBits(U key, RadixKeyType keyType) {
+  const U sign = (U) 1 << (sizeof(U) * 8 - 1);
+  switch (keyType) {
+    case RadixKeyType::INT32:
+    case RadixKeyType::INT64:
+      return key ^ sign;
+    case RadixKeyType::FLOAT:
+    case RadixKeyType::DOUBLE:
+      return key ^ ((0 - (key >> (sizeof(U) * 8 - 1))) | sign);
+    default:
+      return key;
+  }
+}
+
+enum class RadixEngine {
+  // histogram, scan, global sums and reorder dispatch per digit
+  MULTI_PASS,
+  // all digit histograms in one upfront read, then one dispatch per digit that
+  // resolves the global offsets with a decoupled look-back between tiles
+  ONESWEEP
+};
+
+// GPU work of a sort as measured by the timestamp queries of RadixSorterConfig::stageTimestamps.
+// Every stage also covers the fills and barriers recorded between it and the previous stage.
+enum class RadixStage {
+  HISTOGRAM,
+  SCAN,
+  GLOBAL_SUMS,
+  REORDER,
+  ONESWEEP_HISTOGRAM,
+  ONESWEEP,
+  // result copy of sortInPlace after an odd number of passes
+  COPY
+};
+
+const char *radixStageName(RadixStage stage);
+
+struct RadixStageTiming {
+  RadixStage stage;
+  // digit pass of the stage, -1 for the stages that run once per sort
+  int32_t pass;
+  double millis;
+};
+
+// Identifies a sort started by RadixSorter::sortAsync, tickets increase with every sort
+typedef uint64_t SortTicket;
+
+struct RadixSorterConfig {
+  // index into vkEnumeratePhysicalDevices
+  uint32_t deviceIndex = 0;
+  // directory holding the compiled .spv files, with a trailing separator. Empty selects the
+  // SPIR-V embedded at build time, see RADIX_EMBED_SHADERS in CMakeLists.txt.
+#ifdef RADIX_EMBED_SHADERS
+  std::string shaderDir;
+#else
+  std::string shaderDir = "../shaders/";
+#endif
+  // the pipeline cache is loaded from this file and written back when pipelines were added,
+  // so later processes skip most of the driver's shader compilation. Empty disables it.
+  std::string pipelineCachePath = "radix_pipeline_cache.bin";
+  // keep the sort buffers in DEVICE_LOCAL memory and stream keys and values through a host
+  // visible staging ring on the transfer queue, pays off on discrete GPUs. Without narrowKeyRange
+  // the first histogram counts every chunk once its copy is done, while the host fills the next
+  // ones, and is left out of the stage timestamps.
+  bool deviceLocalBuffers = false;
+  // bytes per staging ring slot, rounded down to whole 64 bit keys
+  uint32_t stagingChunkSize = 8 << 20;
+  RadixEngine engine = RadixEngine::MULTI_PASS;
+  // find the smallest and largest key while uploading, sort the keys minus the smallest and skip
+  // the passes above the bits of largest - smallest, e.g. 3 instead of 8 passes for ids in
+  // [2^20, 2^20 + 2^12). Independent of this, a pass whose keys all share one digit copies them
+  // straight through on the device instead of ranking and scattering them: the multi pass reorder
+  // tells from the scanned histogram, onesweep from the upfront digit counts.
+  bool narrowKeyRange = false;
+  // inputs up to this many keys are sorted on the host, where a submit and fence wait would take
+  // longer than the whole sort. 0 sends everything to the device.
+  uint32_t hostSortThreshold = 4096;
+  // write a timestamp query after every dispatch, see RadixSorter::lastStageTimings
+  bool stageTimestamps = false;
+  // rank keys in radix_reorder and radix_onesweep and scan buckets in radix_scan with subgroup ballots
+  // and adds when the device supports them, see RadixSorter::subgroupRanking. Off keeps the shared
+  // memory shaders. The onesweep ranking then needs a digit count per subgroup instead of per thread,
+  // which lets 8 bit digits fit into shared memory.
+  bool subgroupRanking = true;
+  // sorts RadixSorter::sortAsync keeps in flight. Every one has its own command buffer, fence and
+  // sort buffers, so the memory use grows with it.
+  uint32_t asyncJobs = 3;
+  // bytes of the first VkDeviceMemory block of each memory pool, every further block doubles.
+  // The sort buffers are carved out of the blocks and freed ranges are reused. Buffers shrink when a
+  // sort needs a fraction of them, and empty blocks larger than the remaining buffers are freed.
+  uint32_t memoryBlockSize = 64 << 20;
+
+  // Work sizes handed to every shader as specialization constants at pipeline creation,
+  // so all variants run from the same .spv files. The constructor checks them against
+  // the device limits.
+  // bits sorted per pass, 2^radixBits may not exceed the group size of the engine
+  uint32_t radixBits = 4;
+  // work group size of the multi pass shaders
+  uint32_t groupSize = 1024;
+  // buckets summed per work item by radix_scan. A scan level turns groupSize * scanElementsPerWI
+  // buckets into one total, which has to shrink 2^32 buckets to one within four levels.
+  uint32_t scanElementsPerWI = 16;
+  // bits the reorder shader ranks at a time inside a work group, must divide radixBits
+  uint32_t sortRadixBits = 2;
+  // buckets radix_globalsums adds the scanned block totals to per work item
+  uint32_t globalSumsElementsPerWI = 4;
+  // work group size of the onesweep shaders
+  uint32_t onesweepGroupSize = 128;
+  // a onesweep tile holds onesweepGroupSize * onesweepKeysPerThread keys in shared memory
+  uint32_t onesweepKeysPerThread = 8;
+#ifndef NDEBUG
+  bool validation = true;
+#else
+  bool validation = false;
+#endif
+};
+
+class RadixSorter {
+public:
+  explicit RadixSorter(const RadixSorterConfig &config = RadixSorterConfig());
+  ~RadixSorter();
+
+  RadixSorter(const RadixSorter &) = delete;
+  RadixSorter &operator=(const RadixSorter &) = delete;
+
+  // Sorts keys in place
+  template<typename K>
+  void sort(std::span<K> keys) {
+    wait(sortImpl(keys.data(), keys.size(), RadixKeyTraits<K>::type, nullptr, false, false, sizeof(K) * 8));
+  }
+
+  // Sorts keys in place without staging them in a buffer of the sorter. If the device supports
+  // VK_EXT_external_memory_host and keys.data() is a multiple of hostImportAlignment(), the keys
+  // are imported as buffer memory and sorted where they are, e.g. in a MappedFile. The memory has
+  // to be accessible up to the next multiple of the alignment. Otherwise this is sort(keys).
+  template<typename K>
+  void sortInPlace(std::span<K> keys) {
+    wait(sortImpl(keys.data(), keys.size(), RadixKeyTraits<K>::type, nullptr, false, true, sizeof(K) * 8));
+  }
+
+  // Sorts keys in place and moves every value to the position of its key. values.size() must equal keys.size().
+  template<typename K>
+  void sort(std::span<K> keys, std::span<uint32_t> values) {
+    wait(sortImpl(keys.data(), keys.size(), RadixKeyTraits<K>::type, values.data(), false, false, sizeof(K) * 8));
+  }
+
+  // Sorts keys in place and writes the original index of every sorted key to indices.
+  // The indices are generated on the device, nothing is uploaded for them.
+  template<typename K>
+  void argsort(std::span<K> keys, std::span<uint32_t> indices) {
+    wait(sortImpl(keys.data(), keys.size(), RadixKeyTraits<K>::type, indices.data(), true, false, sizeof(K) * 8));
+  }
+
+  // Starts sort(keys) and returns at once. The keys belong to the sorter until wait or finished
+  // report the ticket done, up to RadixSorterConfig::asyncJobs sorts are in flight at a time and
+  // starting another one first finishes the oldest. Inputs up to hostSortThreshold keys are sorted
+  // right away and get a ticket that is already done. The sorter is not thread safe, all calls
+  // have to come from one thread.
+  template<typename K>
+  SortTicket sortAsync(std::span<K> keys) {
+    return sortImpl(keys.data(), keys.size(), RadixKeyTraits<K>::type, nullptr, false, false, sizeof(K) * 8);
+  }
+
+  // sort(keys, values) as sortAsync
+  template<typename K>
+  SortTicket sortAsync(std::span<K> keys, std::span<uint32_t> values) {
+    return sortImpl(keys.data(), keys.size(), RadixKeyTraits<K>::type, values.data(), false, false, sizeof(K) * 8);
+  }
+
+  // argsort as sortAsync
+  template<typename K>
+  SortTicket argsortAsync(std::span<K> keys, std::span<uint32_t> indices) {
+    return sortImpl(keys.data(), keys.size(), RadixKeyTraits<K>::type, indices.data(), true, false, sizeof(K) * 8);
+  }
+
+  // Blocks until the sort of ticket is done and its result is back in the caller's arrays.
+  // A ticket that was never issued ends the process.
+  void wait(SortTicket ticket);
+
+  // Copies the result back and returns true if the device is done with the sort of ticket,
+  // returns false without blocking otherwise. A ticket that was never issued ends the process.
+  bool finished(SortTicket ticket);
+
+  // Sorts every segment of keys on its own, all of them in one submission. segmentOffsets holds the
+  // first index of every segment in ascending order starting at 0, the last segment ends at
+  // keys.size(). The multi pass engine packs short segments together into one work group and
+  // spreads long ones over several, every digit is counted and scanned per segment. 32 bit keys
+  // of the multi pass engine only, and only if its reorder has the shared memory for at least one
+  // segment per work group next to the block sort.
+  template<typename K>
+  void sortSegments(std::span<K> keys, std::span<const uint32_t> segmentOffsets) {
+    static_assert(sizeof(K) == sizeof(uint32_t), "the segmented shaders only take 32 bit keys");
+    sortSegmentsImpl((uint32_t *) keys.data(), keys.size(), RadixKeyTraits<K>::type, segmentOffsets, nullptr);
+  }
+
+  // sortSegments that moves every value to the position of its key
+  template<typename K>
+  void sortSegments(std::span<K> keys, std::span<const uint32_t> segmentOffsets, std::span<uint32_t> values) {
+    static_assert(sizeof(K) == sizeof(uint32_t), "the segmented shaders only take 32 bit keys");
+    sortSegmentsImpl((uint32_t *) keys.data(), keys.size(), RadixKeyTraits<K>::type, segmentOffsets, values.data());
+  }
+
+  // Time from the submit to the end of the last finished sort, without the copies in and out of the
+  // mapped buffers. With sorts in flight it includes the time spent queued behind the others.
+  long long lastSortMillis() const {
+    return lastSortTime;
+  }
+
+  // Device time of every stage of the last finished sort in recording order, empty unless stageTimestamps is set
+  const std::vector<RadixStageTiming> &lastStageTimings() const {
+    return stageTimings;
+  }
+
+  // Sum of lastStageTimings over one stage
+  double lastStageMillis(RadixStage stage) const;
+
+  // lastStageTimings as JSON: the total, the totals per stage and per pass, and every dispatch
+  std::string lastStageTimingsJson() const;
+
+  // Whether the engine runs the subgroup variants of its shaders, radix_scan and radix_reorder or radix_onesweep
+  bool subgroupRanking() const {
+    return subgroupSize != 0;
+  }
+
+  // Alignment of the address and size of host memory sortInPlace can import, 0 if it always copies
+  VkDeviceSize hostImportAlignment() const {
+    return importAlignment;
+  }
+
+private:
+  struct MemoryPool;
+
+  // memory and mapped point into a block of pool, imported buffers own their memory and have no pool
+  struct Buffer {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr;
+    MemoryPool *pool = nullptr;
+    uint32_t block = 0;
+    VkDeviceSize offset = 0;
+    VkDeviceSize allocationSize = 0;
+  };
+
+  // Large VkDeviceMemory blocks of one memory type that buffers are sub-allocated from, so resizing
+  // the sort buffers does not call into the driver once the blocks are big enough
+  struct MemoryBlock {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr;
+    // offset -> size of the unused ranges, neighbours are merged on free
+    std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+  };
+
+  struct MemoryPool {
+    uint32_t typeIndex = VK_MAX_MEMORY_TYPES;
+    bool hostVisible = false;
+    VkDeviceSize firstBlockSize = 0;
+    VkDeviceSize nextBlockSize = 0;
+    // bytes of all live buffers, trimPool frees empty blocks larger than this
+    VkDeviceSize usedSize = 0;
+    // trimmed blocks leave an empty slot with a null memory
+    std::vector<MemoryBlock> blocks;
+  };
+
+  static constexpr uint32_t MAX_SCAN_LEVELS = 4;
+
+  // The keys of a segment inside one work group of a segmented sort, see packSegments.
+  // Must match SegmentPiece in shaders/radix_common.glsl.
+  struct SegmentPiece {
+    uint32_t keyStart;
+    uint32_t histogramBase;
+    uint32_t digitStride;
+  };
+
+  // Everything a sort in flight owns. Every job slot has its own command buffer, buffers and
+  // descriptor sets, so the host can fill one slot while the device sorts the others.
+  struct SortJob {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    // batches of the first histogram that count the staged chunks while the rest is still
+    // uploading, see submitUploadHistogram. Allocated as the chunk count grows.
+    std::vector<VkCommandBuffer> uploadCommandBuffers;
+    VkFence fence = VK_NULL_HANDLE;
+    // Query 0 marks the start of the command buffer, query i + 1 the end of stageTimings[i]
+    VkQueryPool timestampPool = VK_NULL_HANDLE;
+
+    // Even passes use set 0 and read inputBuffer, odd passes use set 1 with the key and value buffers swapped
+    VkDescriptorSet histDescSets[2] = {};
+    // Multi level exclusive scan of the histogram, see recordExclusiveScan. Level i scans the blocks
+    // of its input, the histogram for level 0 and scanTotalBuffers[i - 1] above, in place and writes
+    // the block totals into scanTotalBuffers[i].
+    VkDescriptorSet scanDescSets[MAX_SCAN_LEVELS] = {};
+    VkDescriptorSet reorderDescSets[2] = {};
+    VkDescriptorSet onesweepHistDescSet = VK_NULL_HANDLE;
+    VkDescriptorSet onesweepDescSets[2] = {};
+
+    Buffer inputBuffer;
+    Buffer outputBuffer;
+    Buffer valueInputBuffer;
+    Buffer valueOutputBuffer;
+    Buffer histogramBuffer;
+    Buffer scanTotalBuffers[MAX_SCAN_LEVELS];
+    Buffer digitHistogramBuffer;
+    Buffer partitionStateBuffer;
+    Buffer segmentPieceBuffer;
+    Buffer segmentGroupBuffer;
+    // buffers the descriptor sets point to, in the order of ensureCapacity
+    VkBuffer describedBuffers[9 + MAX_SCAN_LEVELS] = {};
+
+    // the pieces and the first piece of every work group of a segmented sort, see packSegments
+    bool segmented = false;
+    std::vector<SegmentPiece> segmentPieces;
+    std::vector<uint32_t> segmentGroups;
+
+    // dispatch geometry of the sort, only segmented sorts run more than one row of work groups
+    uint32_t wgCount = 0;
+    uint32_t wgRows = 1;
+    uint32_t elementsPerWI = 1;
+    uint32_t histogramLength = 0;
+    uint32_t scanLevels = 0;
+    uint32_t scanLengths[MAX_SCAN_LEVELS] = {};
+    uint32_t tileCount = 0;
+    // subtracted from every encoded key by the first pass, see narrowKeyRange
+    uint64_t keyBias = 0;
+    // the first histogram was submitted chunk by chunk during the upload, commandBuffer starts after it
+    bool uploadHistogram = false;
+
+    // the submitted sort, ticket is 0 while the slot is idle
+    SortTicket ticket = 0;
+    void *keys = nullptr;
+    uint32_t *values = nullptr;
+    VkDeviceSize keyMemSize = 0;
+    VkDeviceSize valueMemSize = 0;
+    uint32_t passes = 0;
+    // sortInPlace keys imported as buffer memory, which stand in for inputBuffer until the job is finished
+    bool imported = false;
+    Buffer ownInputBuffer;
+    std::chrono::high_resolution_clock::time_point submitTime;
+    std::vector<RadixStageTiming> timings;
+  };
+
+  void createInstance(const RadixSorterConfig &config);
+  void createDevice(const RadixSorterConfig &config);
+  void checkConfig(const RadixSorterConfig &config);
+  void createPipelines(const RadixSorterConfig &config);
+  void createDescriptorSets();
+  void createCommandBuffer();
+
+  void ensureBuffer(Buffer &buffer, VkDeviceSize size, bool hostVisible);
+  uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags flags) const;
+  void destroyBuffer(Buffer &buffer);
+  void allocateFromPool(MemoryPool &pool, const VkMemoryRequirements &requirements, Buffer &buffer);
+  bool allocateFromBlock(MemoryPool &pool, uint32_t index, const VkMemoryRequirements &requirements, Buffer &buffer);
+  void freeToPool(Buffer &buffer);
+  void trimPool(MemoryPool &pool);
+  bool importHostBuffer(void *pointer, VkDeviceSize size, Buffer &buffer);
+  void ensureCapacity(size_t length, size_t keySize, bool withValues, std::span<const uint32_t> segmentOffsets);
+  void packSegments(std::span<const uint32_t> segmentOffsets, size_t length);
+  void updateDescriptorSets();
+
+  uint64_t stagedUpload(VkBuffer dst, VkDeviceSize size, const std::function<void(void *, VkDeviceSize, VkDeviceSize)> &fill,
+                        const std::function<void(VkDeviceSize, uint64_t)> &copied = nullptr);
+  void stagedDownload(VkBuffer src, VkDeviceSize size, void *dst, uint64_t waitValue);
+  void submitStagingCopy(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, bool upload, uint64_t waitValue);
+  void waitTimeline(uint64_t value);
+  void submitUploadHistogram(uint32_t batch, uint32_t firstGroup, uint32_t endGroup, uint32_t length, RadixKeyType keyType, uint64_t waitValue);
+
+  // keyBits is the number of low key bits that may differ, the passes over the bits above are skipped.
+  // With segmentOffsets every segment is sorted on its own, see sortSegments.
+  SortTicket sortImpl(void *keys, size_t length, RadixKeyType keyType, uint32_t *values, bool identityValues, bool importKeys, uint32_t keyBits,
+                      std::span<const uint32_t> segmentOffsets = {});
+  void sortSegmentsImpl(uint32_t *keys, size_t length, RadixKeyType keyType, std::span<const uint32_t> segmentOffsets, uint32_t *values);
+  void finishJob(SortJob &sortJob);
+  void checkTicket(SortTicket ticket) const;
+  void releaseImport(SortJob &sortJob);
+  void recordSort(uint32_t passes, uint32_t length, RadixKeyType keyType, bool withValues, bool identityValues, bool resultToInput);
+  void recordPass(uint32_t pass, uint32_t passes, uint32_t length, RadixKeyType keyType, bool withValues, bool identityValues);
+  void recordExclusiveScan(uint32_t pass);
+  void recordOnesweep(uint32_t passes, uint32_t length, RadixKeyType keyType, bool withValues, bool identityValues);
+  void recordTimestamp(RadixStage stage, int32_t pass);
+  void readTimestamps();
+
+  VkInstance instance = VK_NULL_HANDLE;
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  uint32_t queueFamilyIndex = 0;
+  VkQueue queue = VK_NULL_HANDLE;
+  // same as queue if the device has no separate transfer family
+  uint32_t transferFamilyIndex = 0;
+  VkQueue transferQueue = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties memoryProperties = {};
+  RadixEngine engine = RadixEngine::MULTI_PASS;
+  bool narrowKeyRange = false;
+  uint32_t hostSortThreshold = 4096;
+  uint32_t radixBits = 4;
+  uint32_t groupSize = 1024;
+  uint32_t scanBlockSize = 16384;
+  uint32_t globalSumsElementsPerWI = 4;
+  uint32_t maxWgCount = 0;
+  uint32_t onesweepGroupSize = 128;
+  uint32_t onesweepTileSize = 1024;
+  // subgroup size the scan and reorder shaders were specialized for, 0 runs the shared memory shaders
+  uint32_t subgroupSize = 0;
+  // segment pieces a work group of a segmented sort takes at most, 0 if the segmented reorder does not fit
+  uint32_t maxSegmentPieces = 0;
+
+  // 0: radix_histogram, 1: radix_histogram64, 2: radix_scan, 3: radix_globalsums,
+  // 4: radix_reorder, 5: radix_reorder_kv, 6: radix_reorder64, 7: radix_reorder64_kv,
+  // 8: radix_onesweep_histogram, 9: radix_onesweep_histogram64,
+  // 10: radix_onesweep, 11: radix_onesweep_kv, 12: radix_onesweep64, 13: radix_onesweep64_kv,
+  // 14: radix_histogram_segmented, 15: radix_reorder_segmented, 16: radix_reorder_segmented_kv
+  // With subgroupSize set, 2, 4 - 7 and 10 - 13 hold the _subgroup builds of the same shaders.
+  // The onesweep engine only creates the shaders from ONESWEEP_FIRST_SHADER to SEGMENTED_FIRST_SHADER,
+  // the multi pass engine all the others.
+  static constexpr uint32_t SHADER_COUNT = 17;
+  static constexpr uint32_t ONESWEEP_FIRST_SHADER = 8;
+  static constexpr uint32_t SEGMENTED_FIRST_SHADER = 14;
+  VkShaderModule shaderModules[SHADER_COUNT] = {};
+  VkPipeline pipelines[SHADER_COUNT] = {};
+
+  VkDescriptorSetLayout histogramDescSetLayout = VK_NULL_HANDLE;
+  VkDescriptorSetLayout scanDescSetLayout = VK_NULL_HANDLE;
+  VkDescriptorSetLayout reorderDescSetLayout = VK_NULL_HANDLE;
+  VkPipelineLayout histogramPipelineLayout = VK_NULL_HANDLE;
+  VkPipelineLayout scanPipelineLayout = VK_NULL_HANDLE;
+  VkPipelineLayout reorderPipelineLayout = VK_NULL_HANDLE;
+
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+  // job slots of sortAsync, job points to the one being recorded or finished
+  std::vector<SortJob> jobs;
+  SortJob *job = nullptr;
+  SortTicket lastTicket = 0;
+
+  bool stageTimestamps = false;
+  uint32_t timestampCapacity = 0;
+  double timestampPeriod = 1;
+  uint64_t timestampMask = UINT64_MAX;
+  std::vector<RadixStageTiming> stageTimings;
+
+  // one pool per memory type, ensureBuffer picks the type from the requirements of every buffer
+  MemoryPool memoryPools[VK_MAX_MEMORY_TYPES];
+
+  // VK_EXT_external_memory_host, importAlignment is 0 if the device lacks it
+  VkDeviceSize importAlignment = 0;
+  PFN_vkGetMemoryHostPointerPropertiesEXT getMemoryHostPointerProperties = nullptr;
+
+  // Staging ring of the device local mode. Every copy signals the next value of the timeline
+  // semaphore, slotValues holds the value of the last copy that used each slot.
+  static constexpr uint32_t STAGING_SLOTS = 3;
+  bool deviceLocal = false;
+  VkDeviceSize stagingChunkSize = 0;
+  Buffer stagingBuffer;
+  VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+  VkCommandBuffer transferCommandBuffers[STAGING_SLOTS] = {};
+  VkSemaphore timeline = VK_NULL_HANDLE;
+  uint64_t timelineValue = 0;
+  uint64_t slotValues[STAGING_SLOTS] = {};
+
+  long long lastSortTime = 0;
+};
+
+#endif //RADIXCOMPUTE_RADIX_SORTER_H
@@ -3,3 +3,25 @@ C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 radix_his
 C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 radix_scan.comp -o radix_scan.spv
 C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 radix_globalsums.comp -o radix_globalsums.spv
 C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 radix_reorder.comp -o radix_reorder.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DKEY_VALUE radix_reorder.comp -o radix_reorder_kv.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DKEY64 radix_histogram.comp -o radix_histogram64.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DKEY64 radix_reorder.comp -o radix_reorder64.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DKEY64 -DKEY_VALUE radix_reorder.comp -o radix_reorder64_kv.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 radix_onesweep_histogram.comp -o radix_onesweep_histogram.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DKEY64 radix_onesweep_histogram.comp -o radix_onesweep_histogram64.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 radix_onesweep.comp -o radix_onesweep.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DKEY_VALUE radix_onesweep.comp -o radix_onesweep_kv.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DKEY64 radix_onesweep.comp -o radix_onesweep64.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DKEY64 -DKEY_VALUE radix_onesweep.comp -o radix_onesweep64_kv.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSUBGROUP radix_scan.comp -o radix_scan_subgroup.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSUBGROUP radix_reorder.comp -o radix_reorder_subgroup.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSUBGROUP -DKEY_VALUE radix_reorder.comp -o radix_reorder_subgroup_kv.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSUBGROUP -DKEY64 radix_reorder.comp -o radix_reorder64_subgroup.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSUBGROUP -DKEY64 -DKEY_VALUE radix_reorder.comp -o radix_reorder64_subgroup_kv.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSUBGROUP radix_onesweep.comp -o radix_onesweep_subgroup.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSUBGROUP -DKEY_VALUE radix_onesweep.comp -o radix_onesweep_subgroup_kv.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSUBGROUP -DKEY64 radix_onesweep.comp -o radix_onesweep64_subgroup.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSUBGROUP -DKEY64 -DKEY_VALUE radix_onesweep.comp -o radix_onesweep64_subgroup_kv.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSEGMENTED radix_histogram.comp -o radix_histogram_segmented.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSEGMENTED radix_reorder.comp -o radix_reorder_segmented.spv
+C:/VulkanSDK/1.3.204.0/Bin/glslangValidator.exe --target-env vulkan1.2 -DSEGMENTED -DKEY_VALUE radix_reorder.comp -o radix_reorder_segmented_kv.spv
@@ -0,0 +1,184 @@
+// Shared by the radix shaders through GL_GOOGLE_include_directive.
+// The FLAG_* bits must match the ones in radix_sorter.cpp.
+
+// Specialization constants, filled in from RadixSorterConfig when the pipelines are created.
+// The ids must match the map entries in radix_sorter.cpp.
+layout(constant_id = 0) const uint RADIX_BITS = 4;
+layout(constant_id = 1) const uint GROUP_SIZE = 1024;
+// buckets every work item of radix_scan.comp sums up
+layout(constant_id = 2) const uint SCAN_N_PER_WI = 16;
+// the reorder shader sorts its blocks SORT_RADIX_BITS at a time, must divide RADIX_BITS
+layout(constant_id = 3) const uint SORT_RADIX_BITS = 2;
+// buckets every work item of radix_globalsums.comp adds its block offset to
+layout(constant_id = 4) const uint GLOBAL_SUMS_N_PER_WI = 64;
+layout(constant_id = 5) const uint ONESWEEP_GROUP_SIZE = 128;
+layout(constant_id = 6) const uint ONESWEEP_KEYS_PER_THREAD = 8;
+// subgroup size of the device, only read by the -DSUBGROUP variants
+layout(constant_id = 7) const uint SUBGROUP_SIZE = 32;
+// segment pieces a work group of the -DSEGMENTED variants takes at most
+layout(constant_id = 8) const uint SEGMENT_PIECES = 8;
+
+#define RADIX_ELEM_COUNT (1u << RADIX_BITS)
+#define RADIX_MASK (RADIX_ELEM_COUNT - 1u)
+
+// use the element index as the payload instead of reading the value buffer (argsort first pass)
+#define FLAG_IDENTITY_VALUES 1
+// map the keys to order preserving unsigned bits while reading them (first pass)
+#define FLAG_ENCODE_KEYS 2
+// map the keys back to their original bits while writing them (last pass)
+#define FLAG_DECODE_KEYS 4
+// key type, neither bit set means unsigned. The width comes from the KEY64 shader variant.
+#define FLAG_KEY_SIGNED 8
+#define FLAG_KEY_FLOAT 16
+
+// The encoded keys are sorted minus bias, the smallest key of a narrowed key range, so the
+// passes only have to cover the bits of the largest minus the smallest key. 0 without narrowing.
+uint encodeKey(uint key, uint flags, uint bias) {
+    if ((flags & FLAG_ENCODE_KEYS) == 0) {
+        return key;
+    }
+    if ((flags & FLAG_KEY_FLOAT) != 0) {
+        // negative floats flip every bit so larger magnitudes come first, positive ones only the sign
+        key ^= (0u - (key >> 31)) | 0x80000000u;
+    }
+    else if ((flags & FLAG_KEY_SIGNED) != 0) {
+        key ^= 0x80000000u;
+    }
+    return key - bias;
+}
+
+uint decodeKey(uint key, uint flags, uint bias) {
+    if ((flags & FLAG_DECODE_KEYS) == 0) {
+        return key;
+    }
+    key += bias;
+    if ((flags & FLAG_KEY_FLOAT) != 0) {
+        return key ^ (((key >> 31) - 1u) | 0x80000000u);
+    }
+    if ((flags & FLAG_KEY_SIGNED) != 0) {
+        return key ^ 0x80000000u;
+    }
+    return key;
+}
+
+// 64 bit keys and biases are stored as uvec2(low word, high word)
+uvec2 encodeKey64(uvec2 key, uint flags, uvec2 bias) {
+    if ((flags & FLAG_ENCODE_KEYS) == 0) {
+        return key;
+    }
+    if ((flags & FLAG_KEY_FLOAT) != 0) {
+        uint negMask = 0u - (key.y >> 31);
+        key = uvec2(key.x ^ negMask, key.y ^ (negMask | 0x80000000u));
+    }
+    else if ((flags & FLAG_KEY_SIGNED) != 0) {
+        key.y ^= 0x80000000u;
+    }
+    uint borrow;
+    const uint low = usubBorrow(key.x, bias.x, borrow);
+    return uvec2(low, key.y - bias.y - borrow);
+}
+
+uvec2 decodeKey64(uvec2 key, uint flags, uvec2 bias) {
+    if ((flags & FLAG_DECODE_KEYS) == 0) {
+        return key;
+    }
+    uint carry;
+    key.x = uaddCarry(key.x, bias.x, carry);
+    key.y += bias.y + carry;
+    if ((flags & FLAG_KEY_FLOAT) != 0) {
+        uint negMask = (key.y >> 31) - 1u;
+        return uvec2(key.x ^ negMask, key.y ^ (negMask | 0x80000000u));
+    }
+    if ((flags & FLAG_KEY_SIGNED) != 0) {
+        return uvec2(key.x, key.y ^ 0x80000000u);
+    }
+    return key;
+}
+
+// Key bits from bit upwards. Digits may straddle the two words of a 64 bit key and
+// the last digit may reach past the key, those bits read as 0.
+uint keyShift(uint key, uint bit) {
+    return bit < 32 ? key >> bit : 0u;
+}
+
+uint keyShift(uvec2 key, uint bit) {
+    if (bit == 0) {
+        return key.x;
+    }
+    if (bit < 32) {
+        return (key.x >> bit) | (key.y << (32 - bit));
+    }
+    return bit < 64 ? key.y >> (bit - 32) : 0u;
+}
+
+// Lets the shaders move whole keys of either width. KEY_BIAS reads the keyBias push constants,
+// the shaders that encode or decode keys declare them.
+#ifdef KEY64
+#define KEY_T uvec2
+#define KEY_BIAS uvec2(consts.keyBiasLow, consts.keyBiasHigh)
+#define ENCODE_KEY(key, flags) encodeKey64(key, flags, KEY_BIAS)
+#define DECODE_KEY(key, flags) decodeKey64(key, flags, KEY_BIAS)
+#define KEY_BITS 64
+#else
+#define KEY_T uint
+#define KEY_BIAS consts.keyBiasLow
+#define ENCODE_KEY(key, flags) encodeKey(key, flags, KEY_BIAS)
+#define DECODE_KEY(key, flags) decodeKey(key, flags, KEY_BIAS)
+#define KEY_BITS 32
+#endif
+#define KEY_SHIFT(key, bit) keyShift(key, bit)
+#define KEY_PASSES ((KEY_BITS + RADIX_BITS - 1) / RADIX_BITS)
+
+#ifdef SUBGROUP
+// Mask of the valid invocations in the subgroup with the same digit, one ballot per digit bit.
+// The -DSUBGROUP shaders enable GL_KHR_shader_subgroup_ballot before including this file.
+uvec4 matchDigit(uint digit, bool valid) {
+    uvec4 peers = subgroupBallot(valid);
+    for (uint bit = 0; bit < RADIX_BITS; bit++) {
+        const bool set = ((digit >> bit) & 1u) != 0;
+        const uvec4 ballot = subgroupBallot(set);
+        peers &= set ? ballot : ~ballot;
+    }
+    return peers;
+}
+#endif
+
+#ifdef SEGMENTED
+// Compiled with -DSEGMENTED for RadixSorter::sortSegments, 32 bit keys only. The host cuts the
+// segments into pieces, the keys of a segment inside one work group. A long segment spans several
+// work groups and a work group takes up to SEGMENT_PIECES short segments. Piece p of a segment of
+// n pieces counts digit d at histogramBase + d * n, so the histogram holds the segments one after
+// the other and its plain exclusive scan starts every segment at its first key.
+#ifdef KEY64
+#error "the segmented variants only take 32 bit keys"
+#endif
+struct SegmentPiece {
+    uint keyStart;
+    uint histogramBase; // first piece of the segment * RADIX_ELEM_COUNT + index in the segment
+    uint digitStride; // pieces of the segment
+};
+
+// first key of every piece of the work group, followed by the end of its keys
+shared uint groupPieceStart[SEGMENT_PIECES + 1];
+
+// the work groups run in rows of at most 65535
+uint segmentGroupId() {
+    return gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+}
+
+// index of the piece of the work group that holds key idx
+uint findPiece(uint idx, uint pieceCount) {
+    uint low = 0;
+    uint high = pieceCount - 1;
+    while (low < high) {
+        const uint mid = (low + high + 1) / 2;
+        if (groupPieceStart[mid] <= idx) {
+            low = mid;
+        }
+        else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+#endif